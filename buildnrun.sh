@@ -1,11 +1,15 @@
-#g++ pbotest.cpp -std=c++17 -O2 $(sdl2-config --cflags --libs) -lGL -DSTB_IMAGE_IMPLEMENTATION -o pbotest
+#g++ pbotest.cpp -std=c++17 -O2 -pthread $(sdl2-config --cflags --libs) -lGL -DSTB_IMAGE_IMPLEMENTATION -o pbotest
 #echo "Running"
 #./pbotest
 
 
-g++ pbotest.cpp -std=c++17 -g -O0 -fno-omit-frame-pointer $(sdl2-config --cflags --libs) -lGL -DSTB_IMAGE_IMPLEMENTATION -o pbotest
+# AVX2 JPEG kernels must match SSE2 byte for byte; stop before building pbotest if not
+g++ jpegsimdcheck.cpp -std=c++17 -O2 -Wall -o jpegsimdcheck && ./jpegsimdcheck || exit 1
+
+g++ pbotest.cpp -std=c++17 -g -O0 -fno-omit-frame-pointer -pthread $(sdl2-config --cflags --libs) -lGL -DSTB_IMAGE_IMPLEMENTATION -o pbotest
 #echo "Running"
 #./pbotest
 
 
 
+g++ shmproducer.cpp -std=c++17 -O2 -Wall -o shmproducer
@@ -2,13 +2,44 @@
  * pbotest.cpp – SDL2 + OpenGL: 1920×1080 colour‑wave background + bouncing, cycling quad
  *
  * • Starts in **1920 × 1080** fullscreen‑desktop KMS mode.
- * • PNGs tex0.png … tex9.png live in RAM; exactly **one** GL texture object
- *   is reused – overwritten every 10 frames (from frame 100) to show the next image.
- * • Quad moves like a DVD logo, bouncing off edges.
+ * • PNG/JPEG/BMP/TGA tex0 … tex9 live in RAM; GL textures are allocated once per
+ *   size class and reused – overwritten every 200 frames (from frame 100) with
+ *   only the next image's own w×h pixels.
+ * • Bottom-up BMP/TGA rows stay as stored; the quad flips them through its
+ *   texture coordinates instead of the decoder flipping them in memory.
+ * • texN.hdr (Radiance) is kept as RGBA16F half floats and tonemapped in a
+ *   fragment shader; contexts without half-float textures or that shader
+ *   get it tonemapped to RGBA8 on the loader threads instead.
+ * • Mip chains are built by the loader threads (SSE2 2×2 box filter) and
+ *   uploaded with the image, so the shrunken quad samples trilinearly.
+ * • Or `./pbotest anim.gif`: frames are decoded one ahead and shown for the
+ *   GIF's own per-frame delays.
+ * • Or `./pbotest frames/`: every image in the directory. Playlists of 64+
+ *   files are read in batches through io_uring (a pread pool without it);
+ *   --io=mmap|uring|pread and --qd=N override the backend and queue depth.
+ * • --packed keeps the playlist compressed in RAM (row delta + run-length,
+ *   coded in bands on the loader threads) and expands each image straight
+ *   into the PBO when it is uploaded.
+ * • --prefetch decodes nothing up front: each slide is read, decoded, staged
+ *   in a PBO and uploaded at the latest frame its measured stage times
+ *   allow, and only flipped on screen when due.
+ * • The playlist's directory is watched with inotify: new or changed files
+ *   are decoded in the background and swapped in between frames.
+ * • Quad moves like a DVD logo, bouncing off edges. --quads=N bounces N
+ *   smaller copies instead: an AVX2/SSE2 update split over worker threads
+ *   writes straight into the instance buffer, drawn with one instanced call.
+ *   A playlist is then packed into atlas pages, each quad showing a
+ *   different image, and the pages take turns instead.
+ * • Or `./pbotest --shm=/name`: frames pushed at runtime by another process
+ *   through a POSIX shared-memory ring (shmring.h, shmproducer.cpp), the
+ *   newest complete one staged straight into the PBO each frame.
+ * • --all-displays: a window on every display, each with its own context and
+ *   render thread, drawing from one shared set of textures; each display
+ *   reports its own frame rate and late frames.
  * • Minimal console output (fatal errors only).
  *
  * Build:
- *   g++ pbotest.cpp -std=c++17 -O2 -Wall $(sdl2-config --cflags --libs) -lGL \
+ *   g++ pbotest.cpp -std=c++17 -O2 -Wall -pthread $(sdl2-config --cflags --libs) -lGL \
  *       -DSTB_IMAGE_IMPLEMENTATION -o pbotest
  * Run:
  *   SDL_VIDEODRIVER=kmsdrm sudo ./pbotest
@@ -20,21 +51,113 @@
 #include <SDL2/SDL_opengl_glext.h>
 #include <cstdio>
 #include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <cerrno>
 #include <cmath>
 #include <vector>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <unordered_map>
 #include <ostream>
 #include <iostream>
 #include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <linux/io_uring.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 #define STB_IMAGE_STATIC
 #include "stb_image.h"
+// StbDecode reports errors per decode lane; stb only keeps its failure
+// reason per thread when it has thread-locals.
+#ifndef STBI_THREAD_LOCAL
+#error "pbotest decodes on several threads and needs STBI_THREAD_LOCAL for per-call stb_image errors"
+#endif
+#include "shmring.h"
 
 
 
 
 
 
-struct ImageRAM { int w, h; std::vector<unsigned char> rgba; };
+#ifndef GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD
+#define GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD 0x9160
+#endif
+#ifndef GL_HALF_FLOAT_OES
+#define GL_HALF_FLOAT_OES 0x8D61
+#endif
+
+// Image RAM is page aligned and padded to whole pages so drivers with
+// GL_AMD_pinned_memory can DMA straight out of it.
+constexpr size_t PAGE_SIZE_BYTES = 4096;
+
+static size_t page_round(size_t n) { return (n + PAGE_SIZE_BYTES - 1) & ~(PAGE_SIZE_BYTES - 1); }
+
+template <class T> struct PageAllocator {
+    typedef T value_type;
+    PageAllocator() = default;
+    template <class U> PageAllocator(const PageAllocator<U>&) {}
+    T* allocate(size_t n)
+    {
+        void* p = std::aligned_alloc(PAGE_SIZE_BYTES, page_round(std::max<size_t>(n * sizeof(T), 1)));
+        if (!p) throw std::bad_alloc();
+        return (T*)p;
+    }
+    void deallocate(T* p, size_t) { std::free(p); }
+    template <class U> bool operator==(const PageAllocator<U>&) const { return true; }
+    template <class U> bool operator!=(const PageAllocator<U>&) const { return false; }
+};
+
+typedef std::vector<unsigned char, PageAllocator<unsigned char>> PixelBuffer;
+
+// A frame kept compressed in RAM; see "packed frames".
+struct PackedBand { int level, row0, rows; bool raw; size_t at, bytes; };
+struct PackedFrame {
+    std::vector<unsigned char> data;
+    std::vector<PackedBand> bands;
+    size_t rawBytes = 0;
+};
+
+// rgba is 8-bit RGBA, or RGBA16F half floats when half is set. Rows are
+// stored in whatever order the decoder found cheapest; bottomUp says which,
+// and drawing flips through texture coordinates rather than in memory.
+// Mip levels, when built, follow level 0 in the same buffer; levels holds
+// the byte offset of each one after the first. path is the file a playlist
+// image came from, and empty for anything generated. A packed image keeps
+// that same layout compressed in packed, and rgba is empty.
+struct ImageRAM {
+    int w, h; PixelBuffer rgba; bool half = false; bool bottomUp = false;
+    std::vector<size_t> levels;
+    std::string path;
+    PackedFrame packed;
+    bool is_packed() const { return !packed.bands.empty(); }
+    size_t level_offset(int l) const { return l ? levels[l - 1] : 0; }
+    int bpp() const { return half ? 8 : 4; }
+    int mip_count() const { return 1 + (int)levels.size(); }
+    int level_w(int l) const { return std::max(1, w >> l); }
+    int level_h(int l) const { return std::max(1, h >> l); }
+    const unsigned char* level(int l) const { return rgba.data() + level_offset(l); }
+};
 
 
 static SDL_GLContext try_context(SDL_Window* win, int major, int minor, Uint32 profile)
@@ -77,24 +200,18 @@ static SDL_GLContext create_context(SDL_Window* win)
 
 GLint implFmt, implType;
 
-static bool init_sdl(int w, int h, SDL_Window** outWin, SDL_GLContext* outCtx)
+static bool init_sdl(int w, int h, SDL_Window** outWin, SDL_GLContext* outCtx, int display = 0)
 {
     if (SDL_Init(SDL_INIT_VIDEO) < 0) { std::fprintf(stderr, "SDL_Init: %s\n", SDL_GetError()); return false; }
     SDL_SetHint(SDL_HINT_VIDEO_X11_NET_WM_BYPASS_COMPOSITOR, "0");
 
-    SDL_Window* win = SDL_CreateWindow("Bouncing quad – single VRAM texture", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+    SDL_Window* win = SDL_CreateWindow("Bouncing quad – single VRAM texture", SDL_WINDOWPOS_CENTERED_DISPLAY(display), SDL_WINDOWPOS_CENTERED_DISPLAY(display),
                                        w, h, SDL_WINDOW_OPENGL | SDL_WINDOW_FULLSCREEN_DESKTOP);
     if (!win) { std::fprintf(stderr, "SDL_CreateWindow: %s\n", SDL_GetError()); return false; }
 
     SDL_GLContext ctx = create_context(win);
     if (!ctx)  { std::fprintf(stderr, "SDL_GL_CreateContext: %s\n", SDL_GetError()); return false; }
     
-    bool havePBO = (glGetString(GL_VERSION) &&      // 2.1 == core PBO
-                strncmp((const char*)glGetString(GL_VERSION), "2.1", 3) == 0) ||
-               (strstr((const char*)glGetString(GL_EXTENSIONS),
-                       "GL_ARB_pixel_buffer_object") != nullptr);
-    
-                       
     std::cout << "SDL video driverr: "     << SDL_GetCurrentVideoDriver() << "\n";
     std::cout << "GL_VENDOR    : "        << glGetString(GL_VENDOR)   << "\n";
     std::cout << "GL_RENDERER  : "        << glGetString(GL_RENDERER) << "\n";
@@ -104,198 +221,3350 @@ static bool init_sdl(int w, int h, SDL_Window** outWin, SDL_GLContext* outCtx)
     glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_FORMAT, &implFmt);
     glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_TYPE,   &implType);
     printf("native upload format = 0x%04X, type = 0x%04X\n", implFmt, implType);
-    
-    const GLubyte* ext = glGetString(GL_EXTENSIONS);
-    std::cout << "GL_EXTENSIONS: " << ext << "\n";
-
-
-    
-    std::cout << "havePBO:" << havePBO << std::endl;
 
 
     SDL_GL_SetSwapInterval(1);
     *outWin = win; *outCtx = ctx; return true;
 }
 
-// ------------------------------------------------------ PNG loading
-static std::vector<ImageRAM> load_images_to_ram()
+// ------------------------------------------------------ GL capabilities
+// Probed once after context creation; everything else asks this table
+// instead of poking at version strings.
+struct GLCaps {
+    int major = 0, minor = 0;
+    bool es = false;
+    std::unordered_set<std::string> extensions;
+
+    bool pbo = false, mapBufferRange = false, unpackRowLength = false;
+    bool immutableStorage = false, bufferStorage = false, persistentMapping = false;
+    bool timerQuery = false, syncObjects = false;
+    bool pinnedMemory = false, clientStorage = false;
+    bool halfFloatTextures = false, shaders = false, instancing = false, baseInstance = false;
+    bool s3tc = false, rgtc = false, bptc = false, etc2 = false, astc = false;
+    GLenum halfFloatType = 0, halfFloatFormat = 0;   // glTexImage2D type and internal format for RGBA16F
+
+    PFNGLTEXSTORAGE2DPROC texStorage2D = nullptr;
+    PFNGLBUFFERSTORAGEPROC bufferStorageFn = nullptr;
+    PFNGLDRAWARRAYSINSTANCEDPROC drawArraysInstanced = nullptr;
+    PFNGLVERTEXATTRIBDIVISORPROC vertexAttribDivisor = nullptr;
+    PFNGLDRAWARRAYSINSTANCEDBASEINSTANCEPROC drawArraysInstancedBaseInstance = nullptr;
+
+    bool has(const char* ext) const { return extensions.count(ext) != 0; }
+    bool atLeast(int maj, int min) const { return major > maj || (major == maj && minor >= min); }
+    bool gl(int maj, int min) const { return !es && atLeast(maj, min); }
+    bool gles(int maj, int min) const { return es && atLeast(maj, min); }
+};
+
+static GLCaps probe_gl_caps()
 {
-    std::vector<ImageRAM> imgs;
-    for (int i = 0; i < 10; ++i) {
-        char path[32]; std::snprintf(path, sizeof(path), "tex%d.png", i);
-        int w, h, ch; unsigned char* data = stbi_load(path, &w, &h, &ch, 4);
-        if (!data) continue;
-        imgs.push_back({w, h, std::vector<unsigned char>(data, data + w*h*4)});
-        stbi_image_free(data);
-        std::cout << "Loaded img " << path << std::endl;
+    GLCaps c;
+    const char* ver = (const char*)glGetString(GL_VERSION);
+    if (ver) {
+        const char* esPrefix = "OpenGL ES ";
+        c.es = strncmp(ver, esPrefix, strlen(esPrefix)) == 0;
+        if (c.es) ver += strlen(esPrefix);
+        if (sscanf(ver, "%d.%d", &c.major, &c.minor) != 2) c.major = c.minor = 0;
     }
-    if (imgs.empty()) std::fprintf(stderr, "Warning: no texN.png images found.\n");
-    return imgs;
+
+    auto GetStringi = (PFNGLGETSTRINGIPROC)SDL_GL_GetProcAddress("glGetStringi");
+    if (GetStringi && c.major >= 3) {
+        GLint n = 0; glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+        for (GLint i = 0; i < n; ++i)
+            if (const char* e = (const char*)GetStringi(GL_EXTENSIONS, i)) c.extensions.insert(e);
+    } else if (const char* all = (const char*)glGetString(GL_EXTENSIONS)) {
+        for (const char* p = all; *p; ) {
+            const char* e = strchr(p, ' ');
+            size_t len = e ? size_t(e - p) : strlen(p);
+            if (len) c.extensions.insert(std::string(p, len));
+            p += len; while (*p == ' ') ++p;
+        }
+    }
+
+    c.pbo = c.gl(2, 1) || c.gles(3, 0) || c.has("GL_ARB_pixel_buffer_object") ||
+            c.has("GL_EXT_pixel_buffer_object") || c.has("GL_NV_pixel_buffer_object");
+    c.mapBufferRange = c.gl(3, 0) || c.gles(3, 0) || c.has("GL_ARB_map_buffer_range") || c.has("GL_EXT_map_buffer_range");
+    c.unpackRowLength = !c.es || c.gles(3, 0) || c.has("GL_EXT_unpack_subimage");
+
+    if (c.gl(4, 2) || c.gles(3, 0) || c.has("GL_ARB_texture_storage"))
+        c.texStorage2D = (PFNGLTEXSTORAGE2DPROC)SDL_GL_GetProcAddress("glTexStorage2D");
+    if (!c.texStorage2D && c.has("GL_EXT_texture_storage"))
+        c.texStorage2D = (PFNGLTEXSTORAGE2DPROC)SDL_GL_GetProcAddress("glTexStorage2DEXT");
+    c.immutableStorage = c.texStorage2D != nullptr;
+
+    if (c.gl(4, 4) || c.has("GL_ARB_buffer_storage"))
+        c.bufferStorageFn = (PFNGLBUFFERSTORAGEPROC)SDL_GL_GetProcAddress("glBufferStorage");
+    if (!c.bufferStorageFn && c.has("GL_EXT_buffer_storage"))
+        c.bufferStorageFn = (PFNGLBUFFERSTORAGEPROC)SDL_GL_GetProcAddress("glBufferStorageEXT");
+    c.bufferStorage = c.bufferStorageFn != nullptr;
+    c.persistentMapping = c.bufferStorage && c.mapBufferRange;
+
+    c.timerQuery  = c.gl(3, 3) || c.has("GL_ARB_timer_query") || c.has("GL_EXT_disjoint_timer_query");
+    c.syncObjects = c.gl(3, 2) || c.gles(3, 0) || c.has("GL_ARB_sync") || c.has("GL_APPLE_sync");
+
+    c.pinnedMemory  = c.has("GL_AMD_pinned_memory");
+    c.clientStorage = c.has("GL_APPLE_client_storage");
+
+    // ES 2 only has half floats through OES_texture_half_float, with its own
+    // type enum and unsized formats.
+    if (c.gl(3, 0) || c.gles(3, 0) || (c.has("GL_ARB_texture_float") && c.has("GL_ARB_half_float_pixel"))) {
+        c.halfFloatType = GL_HALF_FLOAT; c.halfFloatFormat = GL_RGBA16F;
+    } else if (c.es && c.has("GL_OES_texture_half_float")) {
+        c.halfFloatType = GL_HALF_FLOAT_OES; c.halfFloatFormat = GL_RGBA;
+    }
+    c.halfFloatTextures = c.halfFloatType != 0;
+    c.shaders = c.gl(2, 0) || c.gles(2, 0);
+
+    // Draw call and divisor come from different places below 3.3: 3.1 made
+    // glDrawArraysInstanced core, the divisor still needs ARB_instanced_arrays.
+    if (c.gl(3, 1) || c.gles(3, 0))
+        c.drawArraysInstanced = (PFNGLDRAWARRAYSINSTANCEDPROC)SDL_GL_GetProcAddress("glDrawArraysInstanced");
+    else if (c.has("GL_ARB_draw_instanced"))
+        c.drawArraysInstanced = (PFNGLDRAWARRAYSINSTANCEDPROC)SDL_GL_GetProcAddress("glDrawArraysInstancedARB");
+    if (c.gl(3, 3) || c.gles(3, 0))
+        c.vertexAttribDivisor = (PFNGLVERTEXATTRIBDIVISORPROC)SDL_GL_GetProcAddress("glVertexAttribDivisor");
+    else if (c.has("GL_ARB_instanced_arrays"))
+        c.vertexAttribDivisor = (PFNGLVERTEXATTRIBDIVISORPROC)SDL_GL_GetProcAddress("glVertexAttribDivisorARB");
+    c.instancing = c.shaders && c.drawArraysInstanced && c.vertexAttribDivisor;
+    if (c.gl(4, 2) || c.has("GL_ARB_base_instance"))
+        c.drawArraysInstancedBaseInstance = (PFNGLDRAWARRAYSINSTANCEDBASEINSTANCEPROC)SDL_GL_GetProcAddress("glDrawArraysInstancedBaseInstance");
+    if (!c.drawArraysInstancedBaseInstance && c.has("GL_EXT_base_instance"))
+        c.drawArraysInstancedBaseInstance = (PFNGLDRAWARRAYSINSTANCEDBASEINSTANCEPROC)SDL_GL_GetProcAddress("glDrawArraysInstancedBaseInstanceEXT");
+    c.baseInstance = c.instancing && c.drawArraysInstancedBaseInstance;
+
+    c.s3tc = c.has("GL_EXT_texture_compression_s3tc");
+    c.rgtc = c.gl(3, 0) || c.has("GL_ARB_texture_compression_rgtc") || c.has("GL_EXT_texture_compression_rgtc");
+    c.bptc = c.gl(4, 2) || c.has("GL_ARB_texture_compression_bptc") || c.has("GL_EXT_texture_compression_bptc");
+    c.etc2 = c.gl(4, 3) || c.gles(3, 0) || c.has("GL_ARB_ES3_compatibility");
+    c.astc = c.has("GL_KHR_texture_compression_astc_ldr") || c.gles(3, 2);
+    return c;
+}
+
+static void print_gl_caps(const GLCaps& c)
+{
+    printf("GL %s%d.%d, %zu extensions\n", c.es ? "ES " : "", c.major, c.minor, c.extensions.size());
+    printf("  pbo=%d mapRange=%d rowLength=%d immutable=%d bufferStorage=%d persistent=%d\n",
+           c.pbo, c.mapBufferRange, c.unpackRowLength, c.immutableStorage, c.bufferStorage, c.persistentMapping);
+    printf("  timer=%d sync=%d pinned=%d clientStorage=%d\n", c.timerQuery, c.syncObjects, c.pinnedMemory, c.clientStorage);
+    printf("  halfFloat=%d shaders=%d instancing=%d baseInstance=%d\n", c.halfFloatTextures, c.shaders, c.instancing, c.baseInstance);
+    printf("  compression: s3tc=%d rgtc=%d bptc=%d etc2=%d astc=%d\n", c.s3tc, c.rgtc, c.bptc, c.etc2, c.astc);
 }
 
+// ------------------------------------------------------ staging copy
+// Mapped PBOs are usually write-combined, uncached memory. Generic memcpy may
+// pick a strategy tuned for cached destinations, so we also carry streaming
+// (non-temporal) kernels and let a startup benchmark pick per driver.
+typedef void (*CopyFn)(void* dst, const void* src, size_t n);
 
-// ------------------------------------------------------ main
-int main()
+struct CopyKernel { const char* name; CopyFn fn; };
+
+static void copy_memcpy(void* dst, const void* src, size_t n) { memcpy(dst, src, n); }
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static void copy_stream_sse2(void* dst, const void* src, size_t n)
 {
-    constexpr int START_W = 1920;
-    constexpr int START_H = 1080;
+    unsigned char* d = (unsigned char*)dst; const unsigned char* s = (const unsigned char*)src;
+    size_t head = (16 - ((uintptr_t)d & 15)) & 15;
+    if (head > n) head = n;
+    memcpy(d, s, head); d += head; s += head; n -= head;
+    for (; n >= 64; n -= 64, d += 64, s += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(s +  0));
+        __m128i b = _mm_loadu_si128((const __m128i*)(s + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(s + 32));
+        __m128i e = _mm_loadu_si128((const __m128i*)(s + 48));
+        _mm_stream_si128((__m128i*)(d +  0), a);
+        _mm_stream_si128((__m128i*)(d + 16), b);
+        _mm_stream_si128((__m128i*)(d + 32), c);
+        _mm_stream_si128((__m128i*)(d + 48), e);
+    }
+    _mm_sfence();
+    memcpy(d, s, n);
+}
 
-    SDL_Window* win = nullptr; SDL_GLContext ctx = nullptr;
-    if (!init_sdl(START_W, START_H, &win, &ctx)) return EXIT_FAILURE;
-    
-    auto TexStorage2D = (PFNGLTEXSTORAGE2DPROC)SDL_GL_GetProcAddress("glTexStorage2D");
-    auto TexStorage2DEXT = (PFNGLTEXSTORAGE2DEXTPROC)SDL_GL_GetProcAddress("glTexStorage2DEXT");
+__attribute__((target("avx2")))
+static void copy_stream_avx2(void* dst, const void* src, size_t n)
+{
+    unsigned char* d = (unsigned char*)dst; const unsigned char* s = (const unsigned char*)src;
+    size_t head = (32 - ((uintptr_t)d & 31)) & 31;
+    if (head > n) head = n;
+    memcpy(d, s, head); d += head; s += head; n -= head;
+    for (; n >= 128; n -= 128, d += 128, s += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(s +  0));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(s + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i*)(s + 64));
+        __m256i e = _mm256_loadu_si256((const __m256i*)(s + 96));
+        _mm256_stream_si256((__m256i*)(d +  0), a);
+        _mm256_stream_si256((__m256i*)(d + 32), b);
+        _mm256_stream_si256((__m256i*)(d + 64), c);
+        _mm256_stream_si256((__m256i*)(d + 96), e);
+    }
+    _mm_sfence();
+    memcpy(d, s, n);
+}
+#endif
 
-    std::vector<ImageRAM> images = load_images_to_ram();
+static std::vector<CopyKernel> available_copy_kernels()
+{
+    std::vector<CopyKernel> k = { {"memcpy", copy_memcpy} };
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) k.push_back({"stream-sse2", copy_stream_sse2});
+    if (__builtin_cpu_supports("avx2")) k.push_back({"stream-avx2", copy_stream_avx2});
+#endif
+    return k;
+}
 
-    
-    int texW = 2048;
-    int texH = 2048;
-    int texChannels = 4;
-    
-    int texDataSize = texW * texH * texChannels; 
-    
-    const int numPBOS = 2;
-    GLuint pbos[numPBOS];    
-    glGenBuffers(numPBOS,pbos);
-    for(int i = 0;i < numPBOS; i++) {
-      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[i]);
-      glBufferData(GL_PIXEL_UNPACK_BUFFER, texDataSize, nullptr, GL_STREAM_DRAW);
-    }
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-    int pboIndex = 0;
-    
+// Best-of-N timing of every kernel into dst; returns the fastest.
+static CopyKernel pick_copy_kernel(void* dst, const void* src, size_t n, const char* label)
+{
+    const int reps = 5;
+    CopyKernel best = { "memcpy", copy_memcpy };
+    double bestSec = 1e30;
+    for (const CopyKernel& k : available_copy_kernels()) {
+        double sec = 1e30;
+        for (int r = 0; r < reps; ++r) {
+            auto t0 = std::chrono::steady_clock::now();
+            k.fn(dst, src, n);
+            sec = std::min(sec, std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+        }
+        printf("copy bench [%s] %-12s %6.2f GB/s\n", label, k.name, n / sec * 1e-9);
+        if (sec < bestSec) { bestSec = sec; best = k; }
+    }
+    return best;
+}
 
-    GLuint texIDs[2];
-    glGenTextures(2, texIDs);
-    for(int i = 0;i < 2;i++){
-        glBindTexture(GL_TEXTURE_2D, texIDs[i]);
-        //glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 2048, 2048);
-        //TexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 2048, 2048);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2048, 2048, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glBindTexture(GL_TEXTURE_2D, 0);
+// ------------------------------------------------------ worker pool
+// Small persistent pool. run() hands out task indices [0, count) and blocks
+// until all are done; the calling thread works too, so lanes() = workers + 1.
+class WorkerPool {
+public:
+    explicit WorkerPool(int workers)
+    {
+        for (int i = 0; i < workers; ++i) threads.emplace_back([this] { loop(); });
     }
+    ~WorkerPool()
+    {
+        { std::lock_guard<std::mutex> lk(m); quit = true; }
+        wake.notify_all();
+        for (std::thread& t : threads) t.join();
+    }
+    int lanes() const { return (int)threads.size() + 1; }
 
+    void run(int count, const std::function<void(int)>& fn)
+    {
+        if (current == this) { for (int i = 0; i < count; ++i) fn(i); return; }   // nested: no lanes left
+        std::lock_guard<std::mutex> serial(runMutex);
+        {
+            std::lock_guard<std::mutex> lk(m);
+            job = &fn; jobCount = count; next = 0; ++generation;
+        }
+        wake.notify_all();
+        work(fn, count);
+        std::unique_lock<std::mutex> lk(m);
+        done.wait(lk, [this] { return active == 0; });
+        job = nullptr;
+    }
 
-    size_t currentIdx = SIZE_MAX; // force first upload
+private:
+    void work(const std::function<void(int)>& fn, int count)
+    {
+        const WorkerPool* outer = current;
+        current = this;
+        for (int i; (i = next.fetch_add(1)) < count; ) fn(i);
+        current = outer;
+    }
+    void loop()
+    {
+        unsigned seen = 0;
+        std::unique_lock<std::mutex> lk(m);
+        for (;;) {
+            wake.wait(lk, [&] { return quit || (job && generation != seen); });
+            if (quit) return;
+            seen = generation;
+            const std::function<void(int)>* fn = job; int count = jobCount;
+            ++active; lk.unlock();
+            work(*fn, count);
+            lk.lock();
+            if (--active == 0) done.notify_all();
+        }
+    }
 
-    // DVD‑style bouncing physics
-    float quadW = START_W * 0.25f, quadH = START_H * 0.25f;
-    float posX  = (START_W - quadW) * 0.5f;
-    float posY  = (START_H - quadH) * 0.5f;
-    float velX  = 250.0f;   // px/s – tuned for 1080p
-    float velY  = 190.0f;
-    
-    
-    unsigned char* testMemoryCopyPtr = (unsigned char*)malloc(images[0].rgba.size());
-    for(size_t offset = 0; offset < images[0].rgba.size(); offset += 4096){
-      testMemoryCopyPtr[offset] = 0;
+    static inline thread_local const WorkerPool* current = nullptr;   // pool whose task this thread runs
+    std::vector<std::thread> threads;
+    std::mutex m, runMutex;
+    std::condition_variable wake, done;
+    const std::function<void(int)>* job = nullptr;
+    int jobCount = 0, active = 0;
+    std::atomic<int> next{0};
+    unsigned generation = 0;
+    bool quit = false;
+};
+
+static int default_worker_count(int maxLanes = 4)
+{
+    int hw = (int)std::thread::hardware_concurrency();
+    return std::max(1, std::min(hw, maxLanes)) - 1;
+}
+
+// Splits the copy into per-lane chunks whose boundaries fall on destination
+// cache lines, so no two threads write-combine into the same line.
+static void parallel_copy(WorkerPool& pool, CopyFn fn, void* dst, const void* src, size_t n)
+{
+    const size_t line = 64, minChunk = 256 * 1024;
+    int parts = (int)std::min<size_t>(pool.lanes(), n / minChunk);
+    if (parts <= 1) { fn(dst, src, n); return; }
+    uintptr_t base = (uintptr_t)dst;
+    auto boundary = [&](int i) -> size_t {
+        if (i == 0) return 0;
+        if (i == parts) return n;
+        size_t off = ((base + n * i / parts + line - 1) & ~(uintptr_t)(line - 1)) - base;
+        return std::min(off, n);
+    };
+    pool.run(parts, [&](int i) {
+        size_t b = boundary(i), e = boundary(i + 1);
+        fn((unsigned char*)dst + b, (const unsigned char*)src + b, e - b);
+    });
+}
+
+
+// ------------------------------------------------------ half floats
+// HDR images are kept and uploaded as RGBA16F: half the bytes of the float
+// RGBA stb_image returns, and plenty of range for display.
+typedef void (*HalfFn)(uint16_t* dst, const float* src, size_t n);
+
+// Round to nearest even, like F16C; overflow gives inf, NaN stays NaN.
+static uint16_t float_to_half(float f)
+{
+    const uint32_t infinity = 255u << 23, halfMax = (127u + 16) << 23, magicBits = ((127u - 15) + (23 - 10) + 1) << 23;
+    uint32_t x; memcpy(&x, &f, 4);
+    uint32_t sign = x & 0x80000000u;
+    x ^= sign;
+    uint16_t o;
+    if (x >= halfMax) {
+        o = x > infinity ? 0x7e00 : 0x7c00;
+    } else if (x < (113u << 23)) {
+        // half denormal: let the FPU round it into the low mantissa bits
+        float magic, v; memcpy(&magic, &magicBits, 4); memcpy(&v, &x, 4);
+        v += magic;
+        memcpy(&x, &v, 4);
+        o = uint16_t(x - magicBits);
+    } else {
+        uint32_t odd = (x >> 13) & 1;
+        x += ((15u - 127) << 23) + 0xfff + odd;
+        o = uint16_t(x >> 13);
     }
-    
-    
-    
-    GLuint drawingTexture = texIDs[0];
-    GLuint uploadingTexture = texIDs[1];
+    return uint16_t(o | (sign >> 16));
+}
 
-    unsigned long frame = 0; Uint32 lastTicks = SDL_GetTicks();
-    bool running = true;
-    float time = 0.0f;
-    float alwaysDT = 0.01666f;
-    while (running) {
-        SDL_Event ev; while (SDL_PollEvent(&ev)) {
-            if (ev.type == SDL_QUIT) running = false;
-            if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_ESCAPE) running = false;
+// Exact: every half is a float.
+static float half_to_float(uint16_t v)
+{
+    uint32_t sign = uint32_t(v & 0x8000) << 16, e = (v >> 10) & 0x1f, m = v & 0x3ff, x;
+    float f;
+    if (e == 31) x = sign | (255u << 23) | (m << 13);
+    else if (e) x = sign | ((e + 127 - 15) << 23) | (m << 13);
+    else { f = m * (1.0f / 16777216.0f); memcpy(&x, &f, 4); x |= sign; }   // denormal: m * 2^-24
+    memcpy(&f, &x, 4);
+    return f;
+}
+
+static void half_scalar(uint16_t* dst, const float* src, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) dst[i] = float_to_half(src[i]);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx,f16c")))
+static void half_f16c(uint16_t* dst, const float* src, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm_storeu_si128((__m128i*)(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+    half_scalar(dst + i, src + i, n - i);
+}
+#endif
+
+static HalfFn pick_half_kernel()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("f16c")) return half_f16c;
+#endif
+    return half_scalar;
+}
+
+// Converts n floats on the pool, in chunks of whole cache lines of output.
+static void floats_to_half(WorkerPool& pool, uint16_t* dst, const float* src, size_t n)
+{
+    static const HalfFn fn = pick_half_kernel();
+    const size_t align = 32, minChunk = 64 * 1024;
+    int parts = (int)std::min<size_t>(pool.lanes(), std::max<size_t>(1, n / minChunk));
+    pool.run(parts, [&](int p) {
+        size_t b = n * p / parts & ~(align - 1), e = p + 1 == parts ? n : n * (p + 1) / parts & ~(align - 1);
+        fn(dst + b, src + b, e - b);
+    });
+}
+
+// The tonemap shader's curve on the CPU, for contexts that can't run it:
+// Reinhard, then gamma 2.2, exposure 1, opaque.
+static unsigned char tonemap_channel(float c)
+{
+    if (!(c > 0.0f)) return 0;                       // negative or NaN
+    c = std::isinf(c) ? 1.0f : c / (1.0f + c);
+    return (unsigned char)(std::pow(c, 1.0f / 2.2f) * 255.0f + 0.5f);
+}
+
+static void tonemap_to_rgba8(WorkerPool& pool, unsigned char* dst, const float* src, size_t pixels)
+{
+    const size_t minChunk = 16 * 1024;
+    int parts = (int)std::min<size_t>(pool.lanes(), std::max<size_t>(1, pixels / minChunk));
+    pool.run(parts, [&](int p) {
+        for (size_t i = pixels * p / parts, e = pixels * (p + 1) / parts; i < e; ++i) {
+            for (int k = 0; k < 3; ++k) dst[i * 4 + k] = tonemap_channel(src[i * 4 + k]);
+            dst[i * 4 + 3] = 255;
         }
+    });
+}
 
-        
-        time += 0.016667f;
-        Uint32 now = SDL_GetTicks();
-        //float dt = (now - lastTicks) * 0.001f; lastTicks = now;
-        float dt = alwaysDT;
 
-        // Background colour wave
-        //float t = now * 0.001f;
-        float t = time;
-        float rc = 0.5f + 0.5f * std::sin(t);
-        float gc = 0.5f + 0.5f * std::sin(t + 2.094395f);
-        float bc = 0.5f + 0.5f * std::sin(t + 4.188790f);
+// ------------------------------------------------------ mipmaps
+// Drawn at a quarter of its size, a texture without mips makes the sampler
+// skip across 4×4 texel blocks: it aliases and wastes texture cache. The
+// loader builds the chain itself with a 2×2 box filter on the decode pool,
+// so the render thread never runs glGenerateMipmap. Odd sizes round down,
+// like GL's own level sizes; a 1-wide level averages only vertically.
+// 8-bit images are filtered in their stored (sRGB) values, HDR images in
+// linear float before the half conversion.
 
-        int dw, dh; SDL_GL_GetDrawableSize(win, &dw, &dh);
-        glViewport(0, 0, dw, dh);
-        glClearColor(rc, gc, bc, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
+// Level 0 size plus the pixel offset of every further level, each starting
+// on a 16-pixel boundary so rows of a level never share a cache line with
+// the previous one.
+static std::vector<size_t> mip_layout(int w, int h, size_t& totalPixels)
+{
+    std::vector<size_t> offsets;
+    size_t at = size_t(w) * h;
+    while (w > 1 || h > 1) {
+        w = std::max(1, w >> 1); h = std::max(1, h >> 1);
+        at = (at + 15) & ~size_t(15);
+        offsets.push_back(at);
+        at += size_t(w) * h;
+    }
+    totalPixels = at;
+    return offsets;
+}
 
-        if (frame >= 100 && !images.empty()) {
-            size_t newIdx = ((frame - 100) / 200) % images.size();
-            if (newIdx != currentIdx) {
-                const ImageRAM& img = images[newIdx];
-                
-                
-                /*
-                auto startt = std::chrono::steady_clock::now();
-                
-                glBindTexture(GL_TEXTURE_2D, texID);
-                memcpy(testMemoryCopyPtr, img.rgba.data(), img.rgba.size());
-                
-       	        auto elapsedd = (std::chrono::steady_clock::now() - startt).count();
-                std::cout << "Test memcpy:" << std::to_string(elapsedd/1000000) << " ms" << std::endl;
-                */
-                
-                auto start = std::chrono::steady_clock::now();
-                
-                
-                /*glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-                //glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, img.w, img.h, 0, GL_RGBA, GL_UNSIGNED_BYTE, img.rgba.data());
-                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, img.w, img.h,GL_RGBA, GL_UNSIGNED_BYTE,img.rgba.data());*/                
-               	
-                
-                glBindBuffer(GL_PIXEL_UNPACK_BUFFER,pbos[pboIndex]);
-                //glBufferData(GL_PIXEL_UNPACK_BUFFER,texDataSize,nullptr, GL_STREAM_DRAW);
-                
-                void* ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,0,texDataSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
-                memcpy(ptr, img.rgba.data(), texDataSize);
-                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-                
-                glBindTexture(GL_TEXTURE_2D, uploadingTexture);
-                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, img.w, img.h,GL_RGBA, GL_UNSIGNED_BYTE,nullptr); //null means "read from bound pbo"
-                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-                
-                pboIndex++;
-                if(pboIndex == numPBOS)pboIndex = 0;
-                
-                auto elapsed = (std::chrono::steady_clock::now() - start).count();                
-                std::cout << "GPU upload:" << std::to_string(elapsed/1000000) << " ms" << std::endl;
-                currentIdx = newIdx;
-                
+// One output row of ow pixels from source rows r0 and r1 of width w.
+static void down_row_rgba8_scalar(unsigned char* dst, const unsigned char* r0, const unsigned char* r1, int ow, int w)
+{
+    for (int x = 0; x < ow; ++x) {
+        int a = 2 * x * 4, b = std::min(2 * x + 1, w - 1) * 4;
+        for (int c = 0; c < 4; ++c) dst[x * 4 + c] = (unsigned char)((r0[a + c] + r0[b + c] + r1[a + c] + r1[b + c] + 2) >> 2);
+    }
+}
+
+static void down_row_rgbaf_scalar(float* dst, const float* r0, const float* r1, int ow, int w)
+{
+    for (int x = 0; x < ow; ++x) {
+        int a = 2 * x * 4, b = std::min(2 * x + 1, w - 1) * 4;
+        for (int c = 0; c < 4; ++c) dst[x * 4 + c] = ((r0[a + c] + r0[b + c]) + (r1[a + c] + r1[b + c])) * 0.25f;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Four output pixels per step: vertical sums widened to 16 bits, then the
+// horizontal neighbours added by swapping 64-bit halves.
+__attribute__((target("sse2")))
+static void down_row_rgba8_sse2(unsigned char* dst, const unsigned char* r0, const unsigned char* r1, int ow, int w)
+{
+    const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+    auto pairs = [&](__m128i a, __m128i b) {
+        __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+        __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+        __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+        return _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+    };
+    int x = 0;
+    if (w >= 2) {
+        for (; x + 4 <= ow; x += 4) {
+            const unsigned char *a = r0 + x * 8, *b = r1 + x * 8;
+            __m128i p01 = pairs(_mm_loadu_si128((const __m128i*)a),        _mm_loadu_si128((const __m128i*)b));
+            __m128i p23 = pairs(_mm_loadu_si128((const __m128i*)(a + 16)), _mm_loadu_si128((const __m128i*)(b + 16)));
+            _mm_storeu_si128((__m128i*)(dst + x * 4), _mm_packus_epi16(p01, p23));
+        }
+    }
+    down_row_rgba8_scalar(dst + x * 4, r0 + x * 8, r1 + x * 8, ow - x, w - 2 * x);
+}
+
+// Eight output pixels per step: the same, with the packed result's 128-bit
+// lanes (pixels 0,1,4,5 | 2,3,6,7) put back in order.
+__attribute__((target("avx2")))
+static inline __m256i down_pairs_avx2(const unsigned char* a, const unsigned char* b)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i ra = _mm256_loadu_si256((const __m256i*)a), rb = _mm256_loadu_si256((const __m256i*)b);
+    __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(ra, zero), _mm256_unpacklo_epi8(rb, zero));
+    __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(ra, zero), _mm256_unpackhi_epi8(rb, zero));
+    __m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+    return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(2)), 2);
+}
+
+__attribute__((target("avx2")))
+static void down_row_rgba8_avx2(unsigned char* dst, const unsigned char* r0, const unsigned char* r1, int ow, int w)
+{
+    int x = 0;
+    if (w >= 2) {
+        for (; x + 8 <= ow; x += 8) {
+            const unsigned char *a = r0 + x * 8, *b = r1 + x * 8;
+            __m256i p0 = down_pairs_avx2(a, b), p1 = down_pairs_avx2(a + 32, b + 32);
+            _mm256_storeu_si256((__m256i*)(dst + x * 4), _mm256_permute4x64_epi64(_mm256_packus_epi16(p0, p1), 0xd8));
+        }
+    }
+    down_row_rgba8_sse2(dst + x * 4, r0 + x * 8, r1 + x * 8, ow - x, w - 2 * x);
+}
+
+// A pixel is a whole __m128 here, so four output pixels per step means
+// eight loads per row; sums in the scalar order, so results match it.
+__attribute__((target("sse2")))
+static void down_row_rgbaf_sse2(float* dst, const float* r0, const float* r1, int ow, int w)
+{
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    auto pixel = [&](const float* a, const float* b) {
+        __m128 top = _mm_add_ps(_mm_loadu_ps(a), _mm_loadu_ps(a + 4));
+        __m128 bottom = _mm_add_ps(_mm_loadu_ps(b), _mm_loadu_ps(b + 4));
+        return _mm_mul_ps(_mm_add_ps(top, bottom), quarter);
+    };
+    int x = 0;
+    if (w >= 2) {
+        for (; x + 4 <= ow; x += 4) {
+            const float *a = r0 + x * 8, *b = r1 + x * 8;
+            __m128 d0 = pixel(a,      b),      d1 = pixel(a + 8,  b + 8);
+            __m128 d2 = pixel(a + 16, b + 16), d3 = pixel(a + 24, b + 24);
+            _mm_storeu_ps(dst + x * 4,      d0);
+            _mm_storeu_ps(dst + x * 4 + 4,  d1);
+            _mm_storeu_ps(dst + x * 4 + 8,  d2);
+            _mm_storeu_ps(dst + x * 4 + 12, d3);
+        }
+    }
+    down_row_rgbaf_scalar(dst + x * 4, r0 + x * 8, r1 + x * 8, ow - x, w - 2 * x);
+}
+
+// Two output pixels per register, four per step: source pixels 0,1 | 2,3
+// are regrouped into 0,2 | 1,3 so one add sums each horizontal pair.
+__attribute__((target("avx")))
+static inline __m256 down_pairs_avx(const float* a, const float* b)
+{
+    __m256 a01 = _mm256_loadu_ps(a), a23 = _mm256_loadu_ps(a + 8);
+    __m256 b01 = _mm256_loadu_ps(b), b23 = _mm256_loadu_ps(b + 8);
+    __m256 top = _mm256_add_ps(_mm256_permute2f128_ps(a01, a23, 0x20), _mm256_permute2f128_ps(a01, a23, 0x31));
+    __m256 bottom = _mm256_add_ps(_mm256_permute2f128_ps(b01, b23, 0x20), _mm256_permute2f128_ps(b01, b23, 0x31));
+    return _mm256_mul_ps(_mm256_add_ps(top, bottom), _mm256_set1_ps(0.25f));
+}
+
+__attribute__((target("avx")))
+static void down_row_rgbaf_avx(float* dst, const float* r0, const float* r1, int ow, int w)
+{
+    int x = 0;
+    if (w >= 2) {
+        for (; x + 4 <= ow; x += 4) {
+            const float *a = r0 + x * 8, *b = r1 + x * 8;
+            _mm256_storeu_ps(dst + x * 4,     down_pairs_avx(a, b));
+            _mm256_storeu_ps(dst + x * 4 + 8, down_pairs_avx(a + 16, b + 16));
+        }
+    }
+    down_row_rgbaf_sse2(dst + x * 4, r0 + x * 8, r1 + x * 8, ow - x, w - 2 * x);
+}
+#endif
+
+typedef void (*DownRow8Fn)(unsigned char* dst, const unsigned char* r0, const unsigned char* r1, int ow, int w);
+typedef void (*DownRowFFn)(float* dst, const float* r0, const float* r1, int ow, int w);
+
+static DownRow8Fn pick_down_row_rgba8()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return down_row_rgba8_avx2;
+    return down_row_rgba8_sse2;
+#else
+    return down_row_rgba8_scalar;
+#endif
+}
+
+static DownRowFFn pick_down_row_rgbaf()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx")) return down_row_rgbaf_avx;
+    return down_row_rgbaf_sse2;
+#else
+    return down_row_rgbaf_scalar;
+#endif
+}
+
+// Fills levels 1.. of a chain laid out by mip_layout, each level split into
+// row bands across the pool (inline when already on one of its lanes).
+template <class T, class RowFn>
+static void build_mip_chain(WorkerPool& pool, const T* level0, T* base, const std::vector<size_t>& offsets, int w, int h, RowFn row)
+{
+    const T* src = level0;
+    for (size_t offset : offsets) {
+        int ow = std::max(1, w >> 1), oh = std::max(1, h >> 1);
+        T* dst = base + offset * 4;
+        int bands = (int)std::min<size_t>(pool.lanes(), std::max<size_t>(1, size_t(ow) * oh / (64 * 1024)));
+        pool.run(bands, [&](int b) {
+            for (int y = oh * b / bands; y < oh * (b + 1) / bands; ++y)
+                row(dst + size_t(y) * ow * 4, src + size_t(2 * y) * w * 4, src + size_t(std::min(2 * y + 1, h - 1)) * w * 4, ow, w);
+        });
+        src = dst; w = ow; h = oh;
+    }
+}
+
+// Copies the w×h rgba level0 into img and fills in every level below it.
+static void build_mips(WorkerPool& pool, const unsigned char* level0, int w, int h, ImageRAM& img)
+{
+    size_t total;
+    std::vector<size_t> offsets = mip_layout(w, h, total);
+    img.rgba.resize(total * 4);
+    memcpy(img.rgba.data(), level0, size_t(w) * h * 4);
+    static const DownRow8Fn row = pick_down_row_rgba8();
+    build_mip_chain(pool, img.rgba.data(), img.rgba.data(), offsets, w, h, row);
+    img.levels.clear();
+    for (size_t o : offsets) img.levels.push_back(o * 4);
+}
+
+// HDR: filters rgba floats of w×h and converts every level to half.
+static void build_mips_half(WorkerPool& pool, const float* level0, int w, int h, ImageRAM& img)
+{
+    size_t total, first = size_t(w) * h;
+    std::vector<size_t> offsets = mip_layout(w, h, total);
+    // levels 1.. in float, indexed from the end of level 0
+    std::vector<float> rest((total - first) * 4);
+    std::vector<size_t> restOffsets;
+    for (size_t o : offsets) restOffsets.push_back(o - first);
+    static const DownRowFFn row = pick_down_row_rgbaf();
+    build_mip_chain(pool, level0, rest.data(), restOffsets, w, h, row);
+    img.rgba.resize(total * 8);
+    uint16_t* half = (uint16_t*)img.rgba.data();
+    floats_to_half(pool, half, level0, first * 4);
+    floats_to_half(pool, half + first * 4, rest.data(), rest.size());
+    img.levels.clear();
+    for (size_t o : offsets) img.levels.push_back(o * 8);
+}
+
+// ------------------------------------------------------ packed frames
+// --packed keeps playlist images compressed in RAM and expands them only to
+// upload them, straight into the mapped PBO. The codec is picked for decode
+// speed over ratio: every row becomes its bytewise difference from the row
+// above, and that stream is coded as runs of one repeated 4-byte unit and
+// literal stretches. Flat, gradient and line-art content shrinks many times
+// over; photographic noise hardly at all, and a band that would not shrink
+// is kept raw. Bands of about 256 KB are coded independently so both
+// directions split across the pool, and decoding finishes each row in a
+// cache-resident scratch row before the copy kernel writes it out.
+//
+// Per band, token t < 128 is followed by t + 1 literal units; t >= 128 by
+// one unit repeated t - 127 times.
+
+static void sub_row_scalar(unsigned char* dst, const unsigned char* cur, const unsigned char* prev, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) dst[i] = (unsigned char)(cur[i] - prev[i]);
+}
+
+static void add_row_scalar(unsigned char* row, const unsigned char* prev, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) row[i] = (unsigned char)(row[i] + prev[i]);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static void sub_row_sse2(unsigned char* dst, const unsigned char* cur, const unsigned char* prev, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(cur + i)), _mm_loadu_si128((const __m128i*)(prev + i))));
+    sub_row_scalar(dst + i, cur + i, prev + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void add_row_sse2(unsigned char* row, const unsigned char* prev, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        _mm_storeu_si128((__m128i*)(row + i), _mm_add_epi8(_mm_loadu_si128((const __m128i*)(row + i)), _mm_loadu_si128((const __m128i*)(prev + i))));
+    add_row_scalar(row + i, prev + i, n - i);
+}
+#endif
+
+// Appends the tokens for n units. Repeats shorter than 3 units are cheaper
+// left inside a literal stretch.
+static void pack_units(std::vector<unsigned char>& out, const uint32_t* u, size_t n)
+{
+    size_t i = 0, lit = 0;   // pending literals are [lit, i)
+    auto literals = [&](size_t end) {
+        while (lit < end) {
+            size_t k = std::min<size_t>(128, end - lit);
+            out.push_back((unsigned char)(k - 1));
+            const unsigned char* p = (const unsigned char*)(u + lit);
+            out.insert(out.end(), p, p + k * 4);
+            lit += k;
+        }
+    };
+    while (i < n) {
+        size_t r = 1;
+        while (i + r < n && r < 128 && u[i + r] == u[i]) ++r;
+        if (r >= 3) {
+            literals(i);
+            out.push_back((unsigned char)(127 + r));
+            const unsigned char* p = (const unsigned char*)(u + i);
+            out.insert(out.end(), p, p + 4);
+            lit = i + r;
+        }
+        i += r;
+    }
+    literals(n);
+}
+
+// Hands out the units of one band's token stream, across row boundaries.
+struct UnitReader {
+    const unsigned char* p;
+    size_t left = 0;
+    bool repeat = false;
+    uint32_t unit = 0;
+
+    void fill(uint32_t* out, size_t n)
+    {
+        while (n) {
+            if (!left) {
+                unsigned t = *p++;
+                repeat = t >= 128;
+                left = repeat ? t - 127 : t + 1;
+                if (repeat) { memcpy(&unit, p, 4); p += 4; }
             }
-            
-            
+            size_t k = std::min(n, left);
+            if (repeat) std::fill_n(out, k, unit);
+            else { memcpy(out, p, k * 4); p += k * 4; }
+            out += k; n -= k; left -= k;
+        }
+    }
+};
+
+// Replaces img's pixels, every mip level, with their packed form.
+static void pack_image(WorkerPool& pool, ImageRAM& img)
+{
+    constexpr size_t BAND_BYTES = 256 * 1024;
+    std::vector<PackedBand> bands;
+    for (int l = 0; l < img.mip_count(); ++l) {
+        int rows = (int)std::max<size_t>(1, BAND_BYTES / (size_t(img.level_w(l)) * img.bpp()));
+        for (int y = 0; y < img.level_h(l); y += rows)
+            bands.push_back({ l, y, std::min(rows, img.level_h(l) - y), false, 0, 0 });
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    auto sub_row = sub_row_sse2;
+#else
+    auto sub_row = sub_row_scalar;
+#endif
+    std::vector<std::vector<unsigned char>> coded(bands.size());
+    pool.run((int)bands.size(), [&](int b) {
+        PackedBand& band = bands[b];
+        size_t rowBytes = size_t(img.level_w(band.level)) * img.bpp(), bytes = rowBytes * band.rows;
+        const unsigned char* src = img.level(band.level) + band.row0 * rowBytes;
+        std::vector<uint32_t> delta(bytes / 4);
+        unsigned char* d = (unsigned char*)delta.data();
+        memcpy(d, src, rowBytes);
+        for (int y = 1; y < band.rows; ++y) sub_row(d + y * rowBytes, src + y * rowBytes, src + (y - 1) * rowBytes, rowBytes);
+        pack_units(coded[b], delta.data(), delta.size());
+        if (coded[b].size() >= bytes) { coded[b].assign(src, src + bytes); band.raw = true; }
+    });
+
+    PackedFrame& pf = img.packed;
+    size_t total = 0;
+    for (const std::vector<unsigned char>& c : coded) total += c.size();
+    pf.data.clear(); pf.data.reserve(total);
+    for (size_t b = 0; b < bands.size(); ++b) {
+        bands[b].at = pf.data.size(); bands[b].bytes = coded[b].size();
+        pf.data.insert(pf.data.end(), coded[b].begin(), coded[b].end());
+    }
+    pf.bands = std::move(bands);
+    pf.rawBytes = img.rgba.size();
+    PixelBuffer().swap(img.rgba);
+}
+
+// Expands a packed image into dst, where level l starts at at[l] and its
+// rows are pitch[l] apart. Finished rows are written with copy, the PBO's
+// own streaming kernel when dst is a mapped buffer.
+static void unpack_image(WorkerPool& pool, const ImageRAM& img, unsigned char* dst, const size_t* at, const size_t* pitch, CopyFn copy)
+{
+    const PackedFrame& pf = img.packed;
+#if defined(__x86_64__) || defined(__i386__)
+    auto add_row = add_row_sse2;
+#else
+    auto add_row = add_row_scalar;
+#endif
+    pool.run((int)pf.bands.size(), [&](int b) {
+        const PackedBand& band = pf.bands[b];
+        size_t rowBytes = size_t(img.level_w(band.level)) * img.bpp(), dstPitch = pitch[band.level];
+        unsigned char* out = dst + at[band.level] + band.row0 * dstPitch;
+        const unsigned char* src = pf.data.data() + band.at;
+        if (band.raw) {
+            for (int y = 0; y < band.rows; ++y) copy(out + y * dstPitch, src + y * rowBytes, rowBytes);
+            return;
+        }
+        std::vector<uint32_t> rows(rowBytes / 2);   // this row and the one above
+        uint32_t *cur = rows.data(), *prev = cur + rowBytes / 4;
+        UnitReader units = { src };
+        for (int y = 0; y < band.rows; ++y) {
+            units.fill(cur, rowBytes / 4);
+            if (y) add_row((unsigned char*)cur, (const unsigned char*)prev, rowBytes);
+            copy(out + y * dstPitch, cur, rowBytes);
+            std::swap(cur, prev);
+        }
+    });
+}
+
+// The same into img's own unpacked layout.
+static void unpack_image(WorkerPool& pool, const ImageRAM& img, unsigned char* dst, CopyFn copy)
+{
+    std::vector<size_t> at(img.mip_count()), pitch(img.mip_count());
+    for (int l = 0; l < img.mip_count(); ++l) { at[l] = img.level_offset(l); pitch[l] = size_t(img.level_w(l)) * img.bpp(); }
+    unpack_image(pool, img, dst, at.data(), pitch.data(), copy);
+}
+
+
+// ------------------------------------------------------ batched file reader
+// With thousands of small files the open/stat/read/close syscalls cost more
+// than the reads themselves. BatchFileReader keeps queueDepth files in
+// flight. On io_uring (raw syscalls, no liburing) the opens, statx calls,
+// reads and closes of a whole batch go down in one io_uring_enter. Where
+// io_uring or one of those ops is missing, queueDepth threads do plain
+// open/fstat/pread instead. Each file owns one of queueDepth reusable
+// buffers until its consumer releases it, so memory stays bounded however
+// long the playlist is.
+
+// Just enough of io_uring for BatchFileReader.
+class IoRing {
+public:
+    IoRing() = default;
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+    ~IoRing()
+    {
+        if (sqes) munmap(sqes, sqesSize);
+        if (cqRing && cqRing != sqRing) munmap(cqRing, cqSize);
+        if (sqRing) munmap(sqRing, sqSize);
+        if (fd >= 0) ::close(fd);
+    }
+
+    // False if the kernel has no io_uring, or lacks an op the reader uses.
+    bool init(unsigned entries)
+    {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+        if (fd < 0) return false;
 
-            // update position
-            posX += velX * dt; posY += velY * dt;
-            if (posX <= 0.0f)              { posX = 0.0f;        velX =  fabsf(velX); }
-            if (posX + quadW >= dw)        { posX = dw - quadW;  velX = -fabsf(velX); }
-            if (posY <= 0.0f)              { posY = 0.0f;        velY =  fabsf(velY); }
-            if (posY + quadH >= dh)        { posY = dh - quadH;  velY = -fabsf(velY); }
+        std::vector<unsigned char> probeMem(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+        io_uring_probe* probe = (io_uring_probe*)probeMem.data();
+        if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) < 0) return false;
+        for (int op : { IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE })
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
 
-            // draw quad
-            glMatrixMode(GL_PROJECTION); glPushMatrix(); glLoadIdentity(); glOrtho(0, dw, dh, 0, -1, 1);
-            glMatrixMode(GL_MODELVIEW);  glPushMatrix(); glLoadIdentity();
+        sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cqSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sqSize = cqSize = std::max(sqSize, cqSize);
+        sqRing = map(sqSize, IORING_OFF_SQ_RING);
+        cqRing = single ? sqRing : map(cqSize, IORING_OFF_CQ_RING);
+        sqes = (io_uring_sqe*)map(sqesSize, IORING_OFF_SQES);
+        if (!sqRing || !cqRing || !sqes) return false;
 
-            glEnable(GL_TEXTURE_2D); glBindTexture(GL_TEXTURE_2D, drawingTexture);
-            glBegin(GL_QUADS);
-                glTexCoord2f(0,0); glVertex2f(posX,         posY);
-                glTexCoord2f(1,0); glVertex2f(posX+quadW,  posY);
-                glTexCoord2f(1,1); glVertex2f(posX+quadW,  posY+quadH);
-                glTexCoord2f(0,1); glVertex2f(posX,         posY+quadH);
-            glEnd();
-            glBindTexture(GL_TEXTURE_2D, 0); glDisable(GL_TEXTURE_2D);
+        unsigned char* sq = (unsigned char*)sqRing;
+        unsigned char* cq = (unsigned char*)cqRing;
+        sqHead = (unsigned*)(sq + p.sq_off.head);   sqTail = (unsigned*)(sq + p.sq_off.tail);
+        sqMask = *(unsigned*)(sq + p.sq_off.ring_mask);
+        sqArray = (unsigned*)(sq + p.sq_off.array);
+        sqEntries = p.sq_entries;
+        cqHead = (unsigned*)(cq + p.cq_off.head);   cqTail = (unsigned*)(cq + p.cq_off.tail);
+        cqMask = *(unsigned*)(cq + p.cq_off.ring_mask);
+        cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+        localTail = *sqTail;
+        return true;
+    }
+
+    // A zeroed SQE to fill in; submits what's queued first if the SQ is full.
+    io_uring_sqe* sqe()
+    {
+        while (localTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) submit(0);
+        unsigned i = localTail++ & sqMask;
+        sqArray[i] = i;
+        std::memset(&sqes[i], 0, sizeof(io_uring_sqe));
+        return &sqes[i];
+    }
+
+    // Submits everything queued and waits for at least minComplete CQEs.
+    void submit(unsigned minComplete)
+    {
+        __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+        unsigned toSubmit = localTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        while (syscall(__NR_io_uring_enter, fd, toSubmit, minComplete,
+                       minComplete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0) < 0 && errno == EINTR) {}
+    }
+
+    template <class F> void reap(F&& f)
+    {
+        unsigned head = *cqHead, tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            io_uring_cqe c = cqes[head & cqMask];
+            __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);   // f may queue more work
+            f(c);
+        }
+    }
+
+private:
+    void* map(size_t size, off_t offset)
+    {
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    int fd = -1;
+    void* sqRing = nullptr; void* cqRing = nullptr; io_uring_sqe* sqes = nullptr;
+    size_t sqSize = 0, cqSize = 0, sqesSize = 0;
+    unsigned *sqHead = nullptr, *sqTail = nullptr, *sqArray = nullptr, sqMask = 0, sqEntries = 0, localTail = 0;
+    unsigned *cqHead = nullptr, *cqTail = nullptr, cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+};
+
+// One file's bytes, valid until release(); ok is false if it couldn't be read.
+struct FileData { size_t index; int slot; const unsigned char* data; size_t size; bool ok; };
+
+class BatchFileReader {
+public:
+    BatchFileReader(const std::vector<std::string>& paths, int queueDepth, bool tryUring)
+        : paths(paths), slots(std::min(std::max(queueDepth, 1), 1024)), start(std::chrono::steady_clock::now())
+    {
+        for (int i = 0; i < (int)slots.size(); ++i) freeSlots.push_back(i);
+        // a file has at most open+statx, or a read, in flight, plus a close
+        // left over from the previous file in its slot
+        if (tryUring && ring.init(unsigned(slots.size()) * 4)) {
+            uring = true;
+            threads.emplace_back([this] { uring_loop(); });
+        } else {
+            size_t n = std::min(slots.size(), paths.size());
+            for (size_t i = 0; i < n; ++i) threads.emplace_back([this] { pread_loop(); });
+        }
+    }
+    ~BatchFileReader()
+    {
+        { std::lock_guard<std::mutex> lk(m); quit = true; }
+        freeCv.notify_all();
+        for (std::thread& t : threads) t.join();
+    }
 
-            glMatrixMode(GL_MODELVIEW);  glPopMatrix();
-            glMatrixMode(GL_PROJECTION); glPopMatrix();
+    // Blocks for the next file to finish, in completion order; false once
+    // every file has been handed out. Safe to call from several threads.
+    bool next(FileData& out)
+    {
+        std::unique_lock<std::mutex> lk(m);
+        readyCv.wait(lk, [this] { return !ready.empty() || handedOut == paths.size(); });
+        if (ready.empty()) return false;
+        out = ready.front(); ready.pop_front();
+        if (++handedOut == paths.size()) readyCv.notify_all();
+        return true;
+    }
+
+    void release(const FileData& f)
+    {
+        { std::lock_guard<std::mutex> lk(m); freeSlots.push_back(f.slot); }
+        freeCv.notify_one();
+    }
+
+    void report() const
+    {
+        double s = std::max(std::chrono::duration<double>(finished - start).count(), 1e-9);
+        double mb = bytes / 1e6;
+        char line[160];
+        std::snprintf(line, sizeof(line), "Read %zu files, %.1f MB in %.0f ms via %s, QD %zu: %.0f IOPS, %.1f MB/s",
+                      paths.size(), mb, s * 1000, uring ? "io_uring" : "pread pool", slots.size(), ios / s, mb / s);
+        std::cout << line << std::endl;
+    }
+
+private:
+    enum : uint64_t { OP_OPEN, OP_STATX, OP_READ, OP_CLOSE };
+
+    struct Slot {
+        std::unique_ptr<unsigned char[]> buf; size_t cap = 0;
+        size_t file = 0, size = 0, done = 0;
+        int fd = -1, waiting = 0; bool failed = false;
+        struct statx stx;
+        void reserve(size_t n) { if (n > cap) { buf.reset(new unsigned char[n]); cap = n; } }
+    };
+
+    // stb takes an int length, so that's the file size limit
+    static bool size_ok(uint64_t n) { return n > 0 && n <= INT_MAX; }
+
+    // Hands out a free slot and the next file for it; false when there's
+    // nothing left to start. waitForSlot blocks until a buffer comes back.
+    bool claim(int& slot, size_t& file, bool waitForSlot)
+    {
+        std::unique_lock<std::mutex> lk(m);
+        if (waitForSlot) freeCv.wait(lk, [this] { return quit || nextFile == paths.size() || !freeSlots.empty(); });
+        if (quit || nextFile == paths.size() || freeSlots.empty()) return false;
+        slot = freeSlots.front(); freeSlots.pop_front();
+        file = nextFile++;
+        return true;
+    }
+
+    void deliver(int slot, bool ok)
+    {
+        Slot& s = slots[slot];
+        {
+            std::lock_guard<std::mutex> lk(m);
+            ready.push_back({ s.file, slot, s.buf.get(), ok ? s.size : 0, ok });
+            if (ok) bytes += s.size;
+            finished = std::chrono::steady_clock::now();
+        }
+        readyCv.notify_one();
+    }
+
+    void pread_loop()
+    {
+        int slot; size_t file;
+        while (claim(slot, file, true)) {
+            Slot& s = slots[slot];
+            s.file = file; s.size = 0;
+            bool ok = false;
+            int fd = ::open(paths[file].c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat st;
+            if (fd >= 0 && fstat(fd, &st) == 0 && size_ok(uint64_t(st.st_size))) {
+                s.size = size_t(st.st_size);
+                s.reserve(s.size);
+                size_t done = 0;
+                for (;;) {
+                    ssize_t r = pread(fd, s.buf.get() + done, s.size - done, off_t(done));
+                    if (r < 0 && errno == EINTR) continue;
+                    if (r <= 0) break;
+                    ++ios; done += size_t(r);
+                    if (done == s.size) break;
+                }
+                ok = done == s.size;
+            }
+            if (fd >= 0) ::close(fd);
+            deliver(slot, ok);
+        }
+    }
+
+    void uring_loop()
+    {
+        int inflight = 0;
+        auto queue = [&](int slot, uint64_t op) {
+            Slot& s = slots[slot];
+            io_uring_sqe* e = ring.sqe();
+            e->user_data = uint64_t(slot) << 2 | op;
+            switch (op) {
+            case OP_OPEN:
+                e->opcode = IORING_OP_OPENAT; e->fd = AT_FDCWD;
+                e->addr = (uint64_t)paths[s.file].c_str(); e->open_flags = O_RDONLY | O_CLOEXEC;
+                break;
+            case OP_STATX:
+                e->opcode = IORING_OP_STATX; e->fd = AT_FDCWD;
+                e->addr = (uint64_t)paths[s.file].c_str(); e->len = STATX_SIZE; e->off = (uint64_t)&s.stx;
+                break;
+            case OP_READ:
+                e->opcode = IORING_OP_READ; e->fd = s.fd;
+                e->addr = (uint64_t)(s.buf.get() + s.done); e->len = unsigned(s.size - s.done); e->off = s.done;
+                break;
+            case OP_CLOSE:
+                e->opcode = IORING_OP_CLOSE; e->fd = s.fd;
+                s.fd = -1;
+                break;
+            }
+            ++inflight;
+        };
+        auto finish = [&](int slot) {
+            Slot& s = slots[slot];
+            if (s.fd >= 0) queue(slot, OP_CLOSE);   // completes in the background
+            deliver(slot, !s.failed);
+        };
+        auto opened_and_sized = [&](int slot) {
+            Slot& s = slots[slot];
+            if (--s.waiting) return;
+            if (s.failed) { finish(slot); return; }
+            s.reserve(s.size);
+            queue(slot, OP_READ);
+        };
+
+        for (;;) {
+            int slot; size_t file;
+            while (claim(slot, file, inflight == 0)) {
+                Slot& s = slots[slot];
+                s.file = file; s.size = s.done = 0; s.fd = -1; s.failed = false; s.waiting = 2;
+                queue(slot, OP_OPEN);
+                queue(slot, OP_STATX);
+            }
+            if (inflight == 0) return;   // nothing left to start or wait for
+            ring.submit(1);
+            ring.reap([&](const io_uring_cqe& c) {
+                int slot = int(c.user_data >> 2);
+                Slot& s = slots[slot];
+                --inflight;
+                switch (c.user_data & 3) {
+                case OP_OPEN:
+                    if (c.res < 0) s.failed = true; else s.fd = c.res;
+                    opened_and_sized(slot);
+                    break;
+                case OP_STATX:
+                    if (c.res < 0 || !size_ok(s.stx.stx_size)) s.failed = true; else s.size = size_t(s.stx.stx_size);
+                    opened_and_sized(slot);
+                    break;
+                case OP_READ:
+                    ++ios;
+                    if (c.res <= 0) s.failed = true; else s.done += size_t(c.res);
+                    if (!s.failed && s.done < s.size) queue(slot, OP_READ);   // short read
+                    else finish(slot);
+                    break;
+                case OP_CLOSE:
+                    break;
+                }
+            });
+        }
+    }
+
+    const std::vector<std::string>& paths;
+    std::vector<Slot> slots;
+    IoRing ring;
+    bool uring = false;
+    std::vector<std::thread> threads;
+    std::mutex m;
+    std::condition_variable freeCv, readyCv;
+    std::deque<int> freeSlots;
+    std::deque<FileData> ready;
+    size_t nextFile = 0, handedOut = 0;
+    bool quit = false;
+    std::atomic<size_t> ios{0};
+    size_t bytes = 0;
+    std::chrono::steady_clock::time_point start, finished;
+};
+
+
+// ------------------------------------------------------ image loading
+// stb_image hands independent decode work (e.g. JPEG restart intervals) to
+// this; it only splits streams decoded from memory, so files are mapped whole.
+static void stbi_run_on_pool(void* runner, int count, stbi_parallel_task* task, void* user)
+{
+    static_cast<WorkerPool*>(runner)->run(count, [&](int i) { task(user, i); });
+}
+
+// Read-only mapping of a whole file. Decoders read the page cache directly,
+// with no stdio chunking and no copy into a heap buffer; MADV_SEQUENTIAL
+// makes the kernel read ahead hard and drop pages behind the decoder.
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const char* path)
+    {
+        close();
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0 && st.st_size <= INT_MAX) {   // stb takes an int length
+            void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                base = (const unsigned char*)p; len = size_t(st.st_size);
+                madvise(p, len, MADV_SEQUENTIAL);
+                madvise(p, len, MADV_WILLNEED);
+            }
+        }
+        ::close(fd);   // the mapping keeps the file alive
+        return base != nullptr;
+    }
+    void close()
+    {
+        if (base) munmap((void*)base, len);
+        base = nullptr; len = 0;
+    }
+
+    const unsigned char* data() const { return base; }
+    int size() const { return (int)len; }
+
+private:
+    const unsigned char* base = nullptr;
+    size_t len = 0;
+};
+
+// Starts reading a file into the page cache without waiting for it: the
+// kernel queues the readahead and fadvise returns, so the disk works on the
+// next images while the current one decodes.
+static void readahead_file(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    ::close(fd);
+}
+
+static const char* const IMAGE_EXTS[] = { "png", "jpg", "hdr", "bmp", "tga" };
+
+// Whether a file belongs in the playlist: any image in a directory, only
+// texN images in the working directory.
+static bool is_playlist_name(const char* name, bool inDir)
+{
+    const char* dot = std::strrchr(name, '.');
+    if (!dot) return false;
+    if (!inDir && !(dot - name == 4 && !std::strncmp(name, "tex", 3) && name[3] >= '0' && name[3] <= '9')) return false;
+    for (const char* ext : IMAGE_EXTS)
+        if (!strcasecmp(dot + 1, ext)) return true;
+    return false;
+}
+
+// Every image in dir, sorted by name; without a dir, tex0 ... tex9 in the
+// working directory, taking the first extension found for each.
+static std::vector<std::string> find_playlist(const char* dir)
+{
+    std::vector<std::string> paths;
+    if (!dir) {
+        for (int i = 0; i < 10; ++i) {
+            for (const char* ext : IMAGE_EXTS) {
+                std::string path = "tex" + std::to_string(i) + "." + ext;
+                if (access(path.c_str(), R_OK) == 0) { paths.push_back(path); break; }
+            }
+        }
+        return paths;
+    }
+    DIR* d = opendir(dir);
+    if (!d) { std::fprintf(stderr, "%s: cannot open directory\n", dir); return paths; }
+    while (dirent* e = readdir(d))
+        if (is_playlist_name(e->d_name, true)) paths.push_back(std::string(dir) + "/" + e->d_name);
+    closedir(d);
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+// How load_images_to_ram gets at file bytes. Auto maps small playlists file
+// by file and batches big ones through io_uring, or the pread pool if the
+// kernel has no io_uring.
+enum class FileIo { Auto, Mmap, Uring, Pread };
+
+struct LoadOptions {
+    FileIo io = FileIo::Auto;
+    int queueDepth = 32;
+    const char* dir = nullptr;   // null: tex0 ... tex9
+    bool packed = false;         // keep images compressed until upload
+    bool hdrToRgba8 = false;     // no half-float path: tonemap HDR while decoding
+};
+
+// One stb_image decode carrying its own settings and results, so decode
+// lanes neither read nor leave anything in stb's process-wide flags. The
+// failure reason is stb's thread-local one copied out after the load, which
+// is why the stb_image include above insists on STBI_THREAD_LOCAL.
+class StbDecode {
+public:
+    StbDecode()
+    {
+        stbi_load_options_init(&opt);
+        opt.keep_row_order = 1;   // flipped rows are drawn flipped instead
+    }
+
+    unsigned char* rgba8(const unsigned char* file, int size, int& w, int& h)
+    {
+        int ch; return stbi_load_from_memory_opt(file, size, &w, &h, &ch, 4, &opt);
+    }
+    float* rgba_float(const unsigned char* file, int size, int& w, int& h)
+    {
+        int ch; return stbi_loadf_from_memory_opt(file, size, &w, &h, &ch, 4, &opt);
+    }
+
+    bool bottom_up() const { return opt.bottom_up != 0; }
+    const char* error() const { return opt.failure_reason ? opt.failure_reason : "unknown error"; }
+
+private:
+    stbi_load_options opt;
+};
+
+// pack: keep the result as a packed frame. hdrToRgba8: tonemap HDR images
+// to 8 bits instead of keeping them as half floats.
+static bool decode_image(const char* path, const unsigned char* file, int size, WorkerPool& pool, ImageRAM& out,
+                         bool pack, bool hdrToRgba8)
+{
+    StbDecode dec;
+    int w, h;
+    if (stbi_is_hdr_from_memory(file, size)) {
+        float* data = dec.rgba_float(file, size, w, h);
+        if (!data) { std::fprintf(stderr, "%s: %s\n", path, dec.error()); return false; }
+        out = ImageRAM();
+        out.w = w; out.h = h; out.half = !hdrToRgba8;
+        out.bottomUp = dec.bottom_up();
+        out.path = path;
+        if (out.half) {
+            build_mips_half(pool, data, w, h, out);
+        } else {
+            std::vector<unsigned char> ldr(size_t(w) * h * 4);
+            tonemap_to_rgba8(pool, ldr.data(), data, size_t(w) * h);
+            build_mips(pool, ldr.data(), w, h, out);
+        }
+        stbi_image_free(data);
+        if (pack) pack_image(pool, out);
+        return true;
+    }
+    unsigned char* data = dec.rgba8(file, size, w, h);
+    if (!data) { std::fprintf(stderr, "%s: %s\n", path, dec.error()); return false; }
+    out = ImageRAM();
+    out.w = w; out.h = h; out.half = false;
+    out.bottomUp = dec.bottom_up();
+    out.path = path;
+    build_mips(pool, data, w, h, out);
+    stbi_image_free(data);
+    if (pack) pack_image(pool, out);
+    return true;
+}
+
+static std::vector<ImageRAM> load_mapped(WorkerPool& pool, const std::vector<std::string>& playlist, const LoadOptions& opt)
+{
+    constexpr size_t READAHEAD_FILES = 3;
+    std::vector<ImageRAM> imgs;
+    MappedFile file;
+    for (size_t i = 0; i < std::min(READAHEAD_FILES, playlist.size()); ++i) readahead_file(playlist[i]);
+    for (size_t i = 0; i < playlist.size(); ++i) {
+        if (i + READAHEAD_FILES < playlist.size()) readahead_file(playlist[i + READAHEAD_FILES]);
+        const char* path = playlist[i].c_str();
+        if (!file.open(path)) { std::fprintf(stderr, "%s: cannot map file\n", path); continue; }
+        ImageRAM img;
+        if (!decode_image(path, file.data(), file.size(), pool, img, opt.packed, opt.hdrToRgba8)) continue;
+        std::cout << (img.half ? "Loaded HDR img " : "Loaded img ") << path << std::endl;
+        imgs.push_back(std::move(img));
+    }
+    return imgs;
+}
+
+// Every pool lane takes files as the reader completes them and decodes them
+// whole; stb's own splitting of a single image runs inline on that lane.
+static std::vector<ImageRAM> load_batched(WorkerPool& pool, const std::vector<std::string>& playlist, const LoadOptions& opt)
+{
+    BatchFileReader reader(playlist, opt.queueDepth, opt.io != FileIo::Pread);
+    std::vector<ImageRAM> decoded(playlist.size());
+    std::vector<char> ok(playlist.size(), 0);
+    pool.run(pool.lanes(), [&](int) {
+        FileData f;
+        while (reader.next(f)) {
+            const char* path = playlist[f.index].c_str();
+            if (!f.ok) std::fprintf(stderr, "%s: cannot read file\n", path);
+            else ok[f.index] = decode_image(path, f.data, (int)f.size, pool, decoded[f.index], opt.packed, opt.hdrToRgba8);
+            reader.release(f);
+        }
+    });
+    reader.report();
+    std::vector<ImageRAM> imgs;
+    for (size_t i = 0; i < decoded.size(); ++i)
+        if (ok[i]) imgs.push_back(std::move(decoded[i]));
+    return imgs;
+}
+
+static std::vector<ImageRAM> load_images_to_ram(WorkerPool& pool, const LoadOptions& opt)
+{
+    constexpr size_t BATCH_MIN_FILES = 64;
+    std::vector<std::string> playlist = find_playlist(opt.dir);
+    bool batched = opt.io == FileIo::Uring || opt.io == FileIo::Pread
+                || (opt.io == FileIo::Auto && playlist.size() >= BATCH_MIN_FILES);
+    std::vector<ImageRAM> imgs = batched ? load_batched(pool, playlist, opt) : load_mapped(pool, playlist, opt);
+    if (imgs.empty() && opt.dir) std::fprintf(stderr, "Warning: no images found in %s.\n", opt.dir);
+    else if (imgs.empty()) std::fprintf(stderr, "Warning: no texN.png / .jpg / .hdr / .bmp / .tga images found.\n");
+    if (opt.packed && !imgs.empty()) {
+        size_t raw = 0, packed = 0;
+        for (const ImageRAM& img : imgs) { raw += img.packed.rawBytes; packed += img.packed.data.size(); }
+        printf("Packed %zu images: %.1f MB instead of %.1f MB (%.2fx)\n", imgs.size(), packed / 1e6, raw / 1e6, double(raw) / std::max<size_t>(packed, 1));
+    }
+    return imgs;
+}
+
+// Drops what a context can't show: images larger than GL_MAX_TEXTURE_SIZE.
+// (HDR images without a tonemap program were already made 8-bit.)
+static void drop_unshowable(std::vector<ImageRAM>& images, int maxTex)
+{
+    images.erase(std::remove_if(images.begin(), images.end(), [&](const ImageRAM& img) {
+        bool tooBig = img.w > maxTex || img.h > maxTex;
+        if (tooBig) std::fprintf(stderr, "Skipping %dx%d image, GL_MAX_TEXTURE_SIZE is %d\n", img.w, img.h, maxTex);
+        return tooBig;
+    }), images.end());
+}
+
+
+// ------------------------------------------------------ hot reload
+// Watches the playlist's directory through inotify. Files written, moved
+// in, moved out or deleted are collected until the directory has been quiet
+// for 100 ms (editors and copies touch a file several times), then a
+// background thread decodes only those on the pool. The render loop takes
+// each finished batch whole between two frames, so the playlist never shows
+// half of an update.
+struct ReloadBatch {
+    std::vector<std::string> changed;   // every path touched, still there or not
+    std::vector<ImageRAM> decoded;      // the new contents of those that still decode
+};
+
+class DirWatcher {
+public:
+    DirWatcher() = default;
+    DirWatcher(const DirWatcher&) = delete;
+    DirWatcher& operator=(const DirWatcher&) = delete;
+    ~DirWatcher() { stop(); }
+
+    // load.dir null watches the working directory's texN files.
+    bool start(const LoadOptions& load, WorkerPool& decodePool)
+    {
+        const char* watchDir = load.dir, *path = watchDir ? watchDir : ".";
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (inotifyFd < 0 || wakeFd < 0
+            || inotify_add_watch(inotifyFd, path, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) < 0) {
+            std::fprintf(stderr, "%s: cannot watch for changes: %s\n", path, std::strerror(errno));
+            stop();
+            return false;
+        }
+        dir = watchDir; pack = load.packed; hdrToRgba8 = load.hdrToRgba8; pool = &decodePool;
+        thread = std::thread([this] { loop(); });
+        return true;
+    }
+
+    void stop()
+    {
+        if (thread.joinable()) {
+            uint64_t one = 1;
+            if (write(wakeFd, &one, sizeof(one)) < 0) std::perror("eventfd");
+            thread.join();
+        }
+        if (inotifyFd >= 0) ::close(inotifyFd);
+        if (wakeFd >= 0) ::close(wakeFd);
+        inotifyFd = wakeFd = -1;
+    }
+
+    // The changes decoded since the last call, if any.
+    bool take(ReloadBatch& out)
+    {
+        std::lock_guard<std::mutex> lk(m);
+        if (ready.changed.empty()) return false;
+        out = std::move(ready);
+        ready = ReloadBatch();
+        return true;
+    }
+
+private:
+    void loop()
+    {
+        constexpr int QUIET_MS = 100;
+        std::vector<std::string> pending;
+        alignas(inotify_event) char buf[4096];
+        for (;;) {
+            pollfd fds[2] = { { inotifyFd, POLLIN, 0 }, { wakeFd, POLLIN, 0 } };
+            int n = poll(fds, 2, pending.empty() ? -1 : QUIET_MS);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 || fds[1].revents) return;
+            if (n == 0) { decode(pending); pending.clear(); continue; }
+            for (ssize_t len; (len = read(inotifyFd, buf, sizeof(buf))) > 0; ) {
+                for (char* p = buf; p < buf + len; p += sizeof(inotify_event) + ((inotify_event*)p)->len) {
+                    const inotify_event* e = (const inotify_event*)p;
+                    if (e->mask & IN_Q_OVERFLOW) {   // events were lost: look at everything again
+                        std::vector<std::string> all = find_playlist(dir);
+                        pending.insert(pending.end(), all.begin(), all.end());
+                    } else if (e->len && is_playlist_name(e->name, dir != nullptr)) {
+                        pending.push_back(dir ? std::string(dir) + "/" + e->name : std::string(e->name));
+                    }
+                }
+            }
+        }
+    }
+
+    void decode(std::vector<std::string>& paths)
+    {
+        std::sort(paths.begin(), paths.end());
+        paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+        std::vector<ImageRAM> imgs(paths.size());
+        std::vector<char> ok(paths.size(), 0), gone(paths.size(), 0);
+        auto one = [&](int i) {
+            const char* path = paths[i].c_str();
+            MappedFile file;
+            if (access(path, F_OK) != 0) gone[i] = 1;
+            else if (!file.open(path)) std::fprintf(stderr, "%s: cannot map file\n", path);
+            else ok[i] = decode_image(path, file.data(), file.size(), *pool, imgs[i], pack, hdrToRgba8);
+        };
+        // A single file gets the whole pool for its own decode and mips.
+        if (paths.size() == 1) one(0);
+        else pool->run((int)paths.size(), one);
+
+        std::lock_guard<std::mutex> lk(m);
+        for (size_t i = 0; i < paths.size(); ++i) {
+            if (ok[i])        std::cout << "Reloaded img " << paths[i] << std::endl;
+            else if (gone[i]) std::cout << "Removed img " << paths[i] << std::endl;
+            ready.changed.push_back(paths[i]);
+            ready.decoded.erase(std::remove_if(ready.decoded.begin(), ready.decoded.end(),
+                                               [&](const ImageRAM& img) { return img.path == paths[i]; }), ready.decoded.end());
+            if (ok[i]) ready.decoded.push_back(std::move(imgs[i]));
+        }
+    }
+
+    const char* dir = nullptr;
+    bool pack = false, hdrToRgba8 = false;
+    WorkerPool* pool = nullptr;
+    int inotifyFd = -1, wakeFd = -1;
+    std::thread thread;
+    std::mutex m;
+    ReloadBatch ready;
+};
+
+// Replaces every image the batch touched with its new version, if it has
+// one, keeping the playlist sorted by path. retire() sees each outgoing
+// image while its RAM is still alive.
+static void merge_reload(std::vector<ImageRAM>& images, ReloadBatch& batch, const std::function<void(const ImageRAM&)>& retire)
+{
+    std::unordered_set<std::string> changed(batch.changed.begin(), batch.changed.end());
+    images.erase(std::remove_if(images.begin(), images.end(), [&](const ImageRAM& img) {
+        bool out = changed.count(img.path) != 0;
+        if (out) retire(img);
+        return out;
+    }), images.end());
+    for (ImageRAM& img : batch.decoded) images.push_back(std::move(img));
+    std::stable_sort(images.begin(), images.end(), [](const ImageRAM& a, const ImageRAM& b) { return a.path < b.path; });
+}
+
+
+// ------------------------------------------------------ animated source
+// Plays an animated GIF without ever holding all of its frames: a helper
+// thread decodes one frame ahead into the spare of two slots while the other
+// one is on screen, and loops at the end. Delays come from the file; like
+// browsers, anything of 10 ms or less plays as 100 ms.
+class GifSource {
+public:
+    ~GifSource()
+    {
+        { std::lock_guard<std::mutex> lk(m); quit = true; }
+        cv.notify_all();
+        if (decoder.joinable()) decoder.join();
+        stbi_gif_stream_close(stream);
+    }
+
+    bool open(const char* path)
+    {
+        if (!file.open(path)) { std::fprintf(stderr, "%s: cannot map file\n", path); return false; }
+        stream = stbi_gif_stream_open_memory(file.data(), file.size(), &w, &h);
+        if (!stream) { std::fprintf(stderr, "%s: %s\n", path, stbi_failure_reason()); return false; }
+        for (Slot& s : slots) {
+            s.img = ImageRAM();
+            s.img.w = w; s.img.h = h;
+            s.img.rgba = PixelBuffer(size_t(w) * h * 4);
+        }
+        decoder = std::thread([this] { decode_loop(); });
+        std::cout << "Streaming GIF " << path << " (" << w << "x" << h << ")" << std::endl;
+        return true;
+    }
+
+    bool is_open() const { return stream != nullptr; }
+    int width() const { return w; }
+    int height() const { return h; }
+
+    // Takes the next frame, waiting if the decoder is behind; the frame shown
+    // before it goes back to the decoder. nullptr once decoding has failed.
+    const ImageRAM* next(int& delayMs)
+    {
+        std::unique_lock<std::mutex> lk(m);
+        cv.wait(lk, [this] { return ready >= 0 || failed; });
+        if (ready < 0) return nullptr;
+        shown = ready; ready = -1;
+        lk.unlock();
+        cv.notify_all();
+        delayMs = slots[shown].delayMs;
+        return &slots[shown].img;
+    }
+
+private:
+    struct Slot { ImageRAM img; int delayMs; };
+
+    void decode_loop()
+    {
+        int frames = 0;   // since the last rewind
+        for (;;) {
+            int slot;
+            {
+                std::unique_lock<std::mutex> lk(m);
+                cv.wait(lk, [this] { return quit || ready < 0; });
+                if (quit) return;
+                slot = shown == 0 ? 1 : 0;
+            }
+            unsigned char* px = nullptr; int delay = 0;
+            int r = stbi_gif_stream_next(stream, &px, &delay);
+            if (r == 0 && frames > 0) {
+                stbi_gif_stream_rewind(stream);
+                frames = 0;
+                r = stbi_gif_stream_next(stream, &px, &delay);
+            }
+            if (r != 1) {
+                std::fprintf(stderr, "GIF decode: %s\n", r ? stbi_failure_reason() : "no frames");
+                std::lock_guard<std::mutex> lk(m);
+                failed = true;
+                cv.notify_all();
+                return;
+            }
+            ++frames;
+            std::memcpy(slots[slot].img.rgba.data(), px, slots[slot].img.rgba.size());
+            slots[slot].delayMs = delay > 10 ? delay : 100;
+            { std::lock_guard<std::mutex> lk(m); ready = slot; }
+            cv.notify_all();
+        }
+    }
+
+    MappedFile file;   // compressed; stb reads from it until close
+    stbi_gif_stream* stream = nullptr;
+    int w = 0, h = 0;
+    Slot slots[2];
+    std::thread decoder;
+    std::mutex m;
+    std::condition_variable cv;
+    int shown = -1, ready = -1;
+    bool failed = false, quit = false;
+};
+
+
+// ------------------------------------------------------ shared-memory ingest
+// The reading end of shmring.h. Only the newest complete frame is taken, so
+// a producer faster than the display loses frames instead of queueing them;
+// these counters say how many, and how old a frame is once its upload has
+// been issued.
+struct ShmIngestStats {
+    unsigned long shown = 0, dropped = 0, torn = 0;
+    double latencySumMs = 0.0, latencyMaxMs = 0.0;
+
+    void add(uint64_t n, uint64_t prev, bool ok, uint64_t latencyNs)
+    {
+        if (!ok) { ++torn; return; }
+        ++shown;
+        if (prev && n > prev + 1) dropped += n - prev - 1;
+        double ms = latencyNs * 1e-6;
+        latencySumMs += ms;
+        latencyMaxMs = std::max(latencyMaxMs, ms);
+        if (shown % 300 == 0) report();
+    }
+    void report() const
+    {
+        printf("shm: %lu frames shown, %lu dropped, %lu torn, publish to upload %.2f ms avg, %.2f ms max\n",
+               shown, dropped, torn, shown ? latencySumMs / shown : 0.0, latencyMaxMs);
+    }
+};
+
+// CPU time of the slideshow's uploads on the render thread, reported once at
+// exit rather than per slide.
+struct UploadStats {
+    unsigned long count = 0;
+    double sumMs = 0.0, maxMs = 0.0;
+
+    void add(double ms) { ++count; sumMs += ms; maxMs = std::max(maxMs, ms); }
+    void report() const
+    {
+        if (count) printf("upload: %lu slides, %.2f ms avg, %.2f ms max\n", count, sumMs / count, maxMs);
+    }
+};
+
+
+// ------------------------------------------------------ texture/PBO upload
+// Textures are allocated per size class (each axis rounded up to a power of
+// two) so any image fits without respecifying storage; every class keeps a
+// front texture for drawing and a back one for uploading. Staged rows are
+// padded to 64 bytes so each row starts on its own cache line in the PBO.
+// Classes for mipmapped images carry the full chain of levels; each upload
+// caps GL_TEXTURE_MAX_LEVEL at the image's own last level.
+struct SizeClass { int w, h; bool half; GLuint tex[2]; int front; int levels; };
+
+static int full_mip_count(int w, int h) { int n = 1; while ((w | h) >> n) ++n; return n; }
+
+// How pixels get from RAM into a texture, picked from the GLCaps table.
+enum class UploadPath { Direct, PboMapped, Pinned };
+
+static const char* upload_path_name(UploadPath p)
+{
+    switch (p) {
+    case UploadPath::Direct:    return "direct glTexSubImage2D";
+    case UploadPath::PboMapped: return "mapped PBO ring";
+    case UploadPath::Pinned:    return "AMD pinned memory (PBO ring fallback)";
+    }
+    return "?";
+}
+
+static UploadPath choose_upload_path(const GLCaps& c)
+{
+    if (c.pinnedMemory && c.pbo && c.mapBufferRange) return UploadPath::Pinned;
+    if (c.pbo && c.mapBufferRange) return UploadPath::PboMapped;
+    return UploadPath::Direct;
+}
+
+static int size_class_dim(int v) { int c = 64; while (c < v) c <<= 1; return c; }
+
+static GLenum pixel_type(const GLCaps& caps, const ImageRAM& img) { return img.half ? caps.halfFloatType : GL_UNSIGNED_BYTE; }
+
+struct Uploader {
+    static constexpr int numPBOs = 2;
+    GLuint pbos[numPBOs] = {};
+    int pboIndex = 0;
+    size_t pboSize = 0;
+    const GLCaps* caps = nullptr;
+    UploadPath path = UploadPath::Direct;
+    CopyKernel copy = { "memcpy", copy_memcpy };
+    WorkerPool* pool = nullptr;
+    bool parallelFill = false;
+    std::vector<SizeClass> classes;
+    std::unordered_map<const unsigned char*, GLuint> pinned;   // image RAM -> external buffer
+    PixelBuffer unpacked;                                      // packed images on the direct path
+
+    // The PBOs start empty; the first upload sizes them from its own image
+    // and times the copy kernels on that much memory.
+    void init(const GLCaps& glCaps, WorkerPool& copyPool)
+    {
+        caps = &glCaps;
+        pool = &copyPool;
+        path = choose_upload_path(glCaps);
+        std::cout << "Upload path: " << upload_path_name(path) << std::endl;
+        if (path == UploadPath::Direct) return;
+        glGenBuffers(numPBOs, pbos);
+    }
+
+    void reserve(size_t bytes)
+    {
+        if (bytes <= pboSize) return;
+        bool first = pboSize == 0;
+        for (int i = 0; i < numPBOs; i++) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[i]);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        pboSize = bytes;
+        if (first) benchmark();
+    }
+
+    // Pick the staging copy kernel for this driver: cached RAM for reference,
+    // then the real target, a mapped (usually write-combined) PBO.
+    void benchmark()
+    {
+        std::vector<unsigned char> benchSrc(pboSize, 0x5a);
+        std::vector<unsigned char> benchCached(pboSize, 0);
+        pick_copy_kernel(benchCached.data(), benchSrc.data(), pboSize, "cached");
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[0]);
+        if (void* wc = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, pboSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT)) {
+            copy = pick_copy_kernel(wc, benchSrc.data(), pboSize, "PBO");
+
+            // Same kernel, split across the pool; map/unmap stay on this thread.
+            double single = 1e30, multi = 1e30;
+            for (int r = 0; r < 5; ++r) {
+                auto t0 = std::chrono::steady_clock::now();
+                copy.fn(wc, benchSrc.data(), pboSize);
+                auto t1 = std::chrono::steady_clock::now();
+                parallel_copy(*pool, copy.fn, wc, benchSrc.data(), pboSize);
+                auto t2 = std::chrono::steady_clock::now();
+                single = std::min(single, std::chrono::duration<double>(t1 - t0).count());
+                multi  = std::min(multi,  std::chrono::duration<double>(t2 - t1).count());
+            }
+            parallelFill = pool->lanes() > 1 && multi < single;
+            printf("PBO fill: 1 thread %.2f GB/s (%.2f ms), %d threads %.2f GB/s (%.2f ms)\n",
+                   pboSize / single * 1e-9, single * 1e3, pool->lanes(), pboSize / multi * 1e-9, multi * 1e3);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        std::cout << "PBO copy kernel: " << copy.name << (parallelFill ? " (threaded)" : "")
+                  << " (" << glGetString(GL_RENDERER) << ")" << std::endl;
+    }
+
+    GLuint create_texture(int w, int h, bool half, int levels = 1)
+    {
+        GLenum internal = half ? caps->halfFloatFormat : GL_RGBA8, type = half ? caps->halfFloatType : GL_UNSIGNED_BYTE;
+        GLuint tex = 0;
+        glGenTextures(1, &tex);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        if (caps->immutableStorage) caps->texStorage2D(GL_TEXTURE_2D, levels, half ? GL_RGBA16F : GL_RGBA8, w, h);
+        else for (int l = 0; l < levels; ++l)
+            glTexImage2D(GL_TEXTURE_2D, l, internal, std::max(1, w >> l), std::max(1, h >> l), 0, GL_RGBA, type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return tex;
+    }
+
+    SizeClass& class_for(int w, int h, bool half = false, bool mipmapped = false)
+    {
+        int cw = size_class_dim(w), ch = size_class_dim(h), levels = mipmapped ? full_mip_count(cw, ch) : 1;
+        for (SizeClass& c : classes) if (c.w == cw && c.h == ch && c.half == half && c.levels == levels) return c;
+        SizeClass c = { cw, ch, half, {0, 0}, 0, levels };
+        for (int i = 0; i < 2; i++) c.tex[i] = create_texture(cw, ch, half, levels);
+        std::cout << "Texture size class " << cw << "x" << ch << (half ? " RGBA16F" : "") << (levels > 1 ? " mipmapped" : "") << std::endl;
+        classes.push_back(c);
+        return classes.back();
+    }
+
+    // Registers img's RAM with the driver once so later uploads need no CPU
+    // copy. Returns false (and the image keeps using the PBO ring) if the
+    // driver refuses, e.g. because the range is not page aligned.
+    bool pin(const ImageRAM& img)
+    {
+        if (path != UploadPath::Pinned || img.is_packed()) return false;
+        if (pinned.count(img.rgba.data())) return true;
+        if ((uintptr_t)img.rgba.data() & (PAGE_SIZE_BYTES - 1)) return false;
+        while (glGetError() != GL_NO_ERROR) {}
+        GLuint buf = 0;
+        glGenBuffers(1, &buf);
+        glBindBuffer(GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD, buf);
+        glBufferData(GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD, page_round(img.rgba.size()), img.rgba.data(), GL_STREAM_READ);
+        glBindBuffer(GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD, 0);
+        if (glGetError() != GL_NO_ERROR) {
+            glDeleteBuffers(1, &buf);
+            std::fprintf(stderr, "AMD_pinned_memory: could not pin %dx%d image, using PBO ring\n", img.w, img.h);
+            return false;
+        }
+        pinned[img.rgba.data()] = buf;
+        return true;
+    }
+
+    void unpin(const ImageRAM& img)
+    {
+        auto it = pinned.find(img.rgba.data());
+        if (it == pinned.end()) return;
+        glFinish();   // the GPU may still be reading the RAM we are about to release
+        glDeleteBuffers(1, &it->second);
+        pinned.erase(it);
+    }
+
+    // Size class allocation plus pinning, so neither happens mid-playback.
+    void prepare(const ImageRAM& img)
+    {
+        class_for(img.w, img.h, img.half, img.mip_count() > 1);
+        pin(img);
+    }
+
+    // Copies rowBytes per row into dst with dstPitch; a tightly packed image is
+    // a single contiguous copy.
+    void stage_rows(unsigned char* dst, size_t dstPitch, const unsigned char* src, size_t rowBytes, int rows)
+    {
+        if (dstPitch == rowBytes) {
+            if (parallelFill) parallel_copy(*pool, copy.fn, dst, src, rowBytes * rows);
+            else              copy.fn(dst, src, rowBytes * rows);
+            return;
+        }
+        int bands = parallelFill ? std::min(pool->lanes(), rows) : 1;
+        CopyFn fn = copy.fn;
+        auto band = [&](int b) {
+            for (int y = rows * b / bands; y < rows * (b + 1) / bands; ++y)
+                fn(dst + y * dstPitch, src + y * rowBytes, rowBytes);
+        };
+        if (bands > 1) pool->run(bands, band);
+        else           band(0);
+    }
+
+    // Stages exactly w*h*4 bytes of img into its size class' back texture,
+    // then makes that texture the front one.
+    SizeClass& upload(const ImageRAM& img)
+    {
+        SizeClass& c = class_for(img.w, img.h, img.half, img.mip_count() > 1);
+        int back = 1 - c.front;
+        if (upload_to(c.tex[back], img)) c.front = back;
+        return c;
+    }
+
+    // A texture of its own, filled once: for content that never changes,
+    // such as atlas pages. Returns 0 if the upload failed.
+    GLuint upload_static(const ImageRAM& img)
+    {
+        GLuint tex = create_texture(img.w, img.h, img.half, img.mip_count());
+        if (!upload_to(tex, img)) { glDeleteTextures(1, &tex); return 0; }
+        return tex;
+    }
+
+    // RGBA8 frames from memory a producer may be rewriting, such as a shared
+    // memory slot: the CPU copy (into a PBO, or glTexSubImage2D's own from
+    // client memory) goes to the back texture, and only if intact() still
+    // holds once it is done does that become the front one.
+    bool upload_external(SizeClass& c, int w, int h, const unsigned char* src, const std::function<bool()>& intact)
+    {
+        int back = 1 - c.front;
+        glBindTexture(GL_TEXTURE_2D, c.tex[back]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        bool ok;
+        if (path == UploadPath::Direct) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, src);
+            ok = intact();
+        } else {
+            size_t rowBytes = size_t(w) * 4, bytes = rowBytes * h;
+            reserve(bytes);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[pboIndex]);
+            void* ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            ok = ptr != nullptr;
+            if (ok) {
+                stage_rows((unsigned char*)ptr, rowBytes, src, rowBytes, h);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                ok = intact();
+                if (ok) glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            }
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            pboIndex = (pboIndex + 1) % numPBOs;
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        if (ok) c.front = back;
+        return ok;
+    }
+
+    bool upload_to(GLuint tex, const ImageRAM& img)
+    {
+        bind_for_upload(tex);
+        bool ok;
+        auto pinIt = pinned.find(img.rgba.data());
+        if (pinIt != pinned.end())             ok = upload_pinned(pinIt->second, img);
+        else if (path == UploadPath::Direct)   ok = upload_direct(img);
+        else                                   ok = upload_pbo(img);
+        finish_upload(img);
+        return ok;
+    }
+
+    // The same split over two calls, which the prefetcher runs on different
+    // frames: stage() copies img into the next PBO of the ring, after which
+    // its RAM may go, and commit() updates tex from that PBO. The direct path
+    // has nothing to stage, and commit() uploads from RAM.
+    struct Staged { GLuint pbo = 0; std::vector<size_t> at, pitch; };
+
+    bool stage(const ImageRAM& img, Staged& s)
+    {
+        s = Staged();
+        return path == UploadPath::Direct || stage_pbo(img, s);
+    }
+
+    bool commit(GLuint tex, const ImageRAM& img, const Staged& s)
+    {
+        if (!s.pbo) return upload_to(tex, img);
+        bind_for_upload(tex);
+        upload_staged(img, s);
+        finish_upload(img);
+        return true;
+    }
+
+    void bind_for_upload(GLuint tex)
+    {
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+
+    void finish_upload(const ImageRAM& img)
+    {
+        if (img.mip_count() > 1 && (!caps->es || caps->gles(3, 0)))
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, img.mip_count() - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    bool upload_direct(const ImageRAM& img)
+    {
+        const unsigned char* base = img.rgba.data();
+        if (img.is_packed()) {   // no buffer to expand into: use a scratch copy
+            unpacked.resize(img.packed.rawBytes);
+            unpack_image(*pool, img, unpacked.data(), copy_memcpy);
+            base = unpacked.data();
+        }
+        for (int l = 0; l < img.mip_count(); ++l)
+            glTexSubImage2D(GL_TEXTURE_2D, l, 0, 0, img.level_w(l), img.level_h(l), GL_RGBA, pixel_type(*caps, img), base + img.level_offset(l));
+        return true;
+    }
+
+    // The pinned buffer aliases the image RAM, so this is a pure GPU DMA.
+    bool upload_pinned(GLuint buf, const ImageRAM& img)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buf);
+        for (int l = 0; l < img.mip_count(); ++l)
+            glTexSubImage2D(GL_TEXTURE_2D, l, 0, 0, img.level_w(l), img.level_h(l), GL_RGBA, pixel_type(*caps, img),
+                            (const void*)(img.level(l) - img.rgba.data()));
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return true;
+    }
+
+    // All mip levels go into one PBO, each level starting on a cache line.
+    bool upload_pbo(const ImageRAM& img)
+    {
+        Staged s;
+        if (!stage_pbo(img, s)) return false;
+        upload_staged(img, s);
+        return true;
+    }
+
+    bool stage_pbo(const ImageRAM& img, Staged& s)
+    {
+        const int levels = img.mip_count();
+        s.at.assign(levels, 0); s.pitch.assign(levels, 0);
+        size_t bytes = 0;
+        for (int l = 0; l < levels; ++l) {
+            size_t rowBytes = size_t(img.level_w(l)) * img.bpp();
+            s.pitch[l] = caps->unpackRowLength ? (rowBytes + 63) & ~size_t(63) : rowBytes;
+            s.at[l] = bytes;
+            bytes = (bytes + s.pitch[l] * img.level_h(l) + 63) & ~size_t(63);
+        }
+        reserve(bytes);
+
+        GLuint pbo = pbos[pboIndex];
+        pboIndex++;
+        if (pboIndex == numPBOs) pboIndex = 0;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        void* ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (ptr) {
+            if (img.is_packed()) unpack_image(*pool, img, (unsigned char*)ptr, s.at.data(), s.pitch.data(), copy.fn);
+            else for (int l = 0; l < levels; ++l)
+                stage_rows((unsigned char*)ptr + s.at[l], s.pitch[l], img.level(l), size_t(img.level_w(l)) * img.bpp(), img.level_h(l));
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            s.pbo = pbo;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return ptr != nullptr;
+    }
+
+    // Updates the bound texture from a staged PBO; img only supplies the layout.
+    void upload_staged(const ImageRAM& img, const Staged& s)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s.pbo);
+        for (int l = 0; l < img.mip_count(); ++l) {
+            bool padded = s.pitch[l] != size_t(img.level_w(l)) * img.bpp();
+            if (padded) glPixelStorei(GL_UNPACK_ROW_LENGTH, int(s.pitch[l] / img.bpp()));
+            glTexSubImage2D(GL_TEXTURE_2D, l, 0, 0, img.level_w(l), img.level_h(l), GL_RGBA, pixel_type(*caps, img), (const void*)s.at[l]); // offset into the bound pbo
+            if (padded) glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+};
+
+
+// ------------------------------------------------------ prefetch
+// --prefetch decodes nothing up front. The slideshow's timeline is fixed,
+// slide s (playlist entry s % n) going up on frame 100 + 200 s, so the
+// scheduler knows exactly what is needed when and works backwards from
+// there. For the next slide it runs, each at the last frame that still
+// makes the deadline with a 1.5x margin on the measured latencies:
+//   read + decode + mips, on a helper thread using the decode pool;
+//   PBO staging, after which the decoded RAM is freed;
+//   the texture update from that PBO into its size class' back texture;
+// and the due frame itself only flips front and back. So RAM holds at
+// most one decoded image and VRAM nothing beyond the size classes. A
+// late stage runs as soon as it can and the slide goes up late; the
+// estimates rise at once with a slow sample and decay slowly.
+struct Slide { GLuint tex; bool half; float drawU, vTop, vBottom; };
+
+class Prefetcher {
+public:
+    Prefetcher() = default;
+    Prefetcher(const Prefetcher&) = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+    ~Prefetcher()
+    {
+        { std::lock_guard<std::mutex> lk(m); quit = true; }
+        wake.notify_all();
+        if (helper.joinable()) helper.join();
+    }
+
+    bool active() const { return !paths.empty(); }
+
+    // tonemap: whether HDR images can stay half float; if not they are
+    // tonemapped to RGBA8 as they decode.
+    void start(std::vector<std::string> playlist, WorkerPool& decodePool, Uploader& up, bool tonemap, int maxTex)
+    {
+        paths = std::move(playlist);
+        pool = &decodePool; uploader = &up; hdrOk = tonemap; maxTexSize = maxTex;
+        if (paths.empty()) { std::fprintf(stderr, "Warning: nothing to prefetch.\n"); return; }
+        helper = std::thread([this] { decode_loop(); });
+        std::cout << "Prefetching " << paths.size() << " images along the timeline" << std::endl;
+    }
+
+    // Runs whatever stage is due on this frame; true, with out set, when a
+    // new slide goes up.
+    bool tick(unsigned long frame, Slide& out)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (frame > 0) {
+            double ms = std::chrono::duration<double, std::milli>(now - lastTick).count();
+            frameMs = frameMs * 0.9 + std::min(ms, 100.0) * 0.1;
+        }
+        lastTick = now;
+        if (!active() || (paths.size() == 1 && slide > 0)) return false;   // one image stays up
+
+        auto lead = [&](double ms) { return std::max(1L, (long)std::ceil(ms * MARGIN / frameMs)); };
+        long due = long(FIRST_FRAME + slide * SLIDE_FRAMES), f = long(frame);
+        long commitAt = due - lead(commitMs.ms);
+        long stageAt = commitAt - lead(stageMs.ms);
+        long decodeAt = stageAt - lead(decodeMs.ms);
+
+        if (state == State::Idle && f >= decodeAt) {
+            { std::lock_guard<std::mutex> lk(m); job = paths[slide % paths.size()]; }
+            wake.notify_all();
+            state = State::Decoding;
+        }
+        if (state == State::Decoding) {
+            std::lock_guard<std::mutex> lk(m);
+            if (!done) return false;
+            done = false;
+            decodeMs.add(resultMs);
+            if (!resultOk || !showable(result)) { ++skipped; next(); return false; }
+            img = std::move(result);
+            state = State::Decoded;
+        }
+        if (state == State::Decoded && f >= stageAt) {
+            auto t0 = std::chrono::steady_clock::now();
+            uploader->class_for(img.w, img.h, img.half, img.mip_count() > 1);
+            if (!uploader->stage(img, staged)) return false;   // map failed: again next frame
+            if (staged.pbo) PixelBuffer().swap(img.rgba);     // the PBO has it now
+            stageMs.add(ms_since(t0));
+            state = State::Staged;
+            return false;   // the texture update gets a frame of its own
+        }
+        if (state == State::Staged && f >= commitAt) {
+            auto t0 = std::chrono::steady_clock::now();
+            SizeClass& c = uploader->class_for(img.w, img.h, img.half, img.mip_count() > 1);
+            if (!uploader->commit(c.tex[1 - c.front], img, staged)) return false;
+            commitMs.add(ms_since(t0));
+            state = State::Committed;
+        }
+        if (state == State::Committed && f >= due) {
+            SizeClass& c = uploader->class_for(img.w, img.h, img.half, img.mip_count() > 1);
+            c.front = 1 - c.front;
+            float drawV = float(img.h) / c.h;
+            out = { c.tex[c.front], img.half, float(img.w) / c.w, img.bottomUp ? drawV : 0.0f, img.bottomUp ? 0.0f : drawV };
+            long late = f - due;
+            if (late > 0) { ++lateSlides; maxLate = std::max(maxLate, late); }
+            printf("prefetch %s: decode %.1f ms, stage %.1f ms, upload %.1f ms est., %s\n", img.path.c_str(),
+                   decodeMs.ms, stageMs.ms, commitMs.ms, late > 0 ? ("late by " + std::to_string(late) + " frames").c_str() : "on time");
+            ++shown;
+            next();
+            return true;
+        }
+        return false;
+    }
+
+    void report() const
+    {
+        if (active()) printf("prefetch: %lu slides shown, %lu late (worst %ld frames), %lu skipped\n", shown, lateSlides, maxLate, skipped);
+    }
+
+private:
+    static constexpr unsigned long FIRST_FRAME = 100, SLIDE_FRAMES = 200;   // as in the main loop
+    static constexpr double MARGIN = 1.5;
+
+    enum class State { Idle, Decoding, Decoded, Staged, Committed };
+
+    // Jumps to a slower sample at once, follows faster ones slowly.
+    struct Estimate {
+        double ms;
+        void add(double sample) { ms = std::max(sample, ms * 0.75 + sample * 0.25); }
+    };
+
+    static double ms_since(std::chrono::steady_clock::time_point t0)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    bool showable(const ImageRAM& i) const
+    {
+        if (i.w > maxTexSize || i.h > maxTexSize) { std::fprintf(stderr, "Skipping %dx%d image %s, GL_MAX_TEXTURE_SIZE is %d\n", i.w, i.h, i.path.c_str(), maxTexSize); return false; }
+        return true;
+    }
+
+    void next()
+    {
+        img = ImageRAM();
+        staged = Uploader::Staged();
+        state = State::Idle;
+        ++slide;
+    }
+
+    void decode_loop()
+    {
+        std::unique_lock<std::mutex> lk(m);
+        for (;;) {
+            wake.wait(lk, [this] { return quit || !job.empty(); });
+            if (quit) return;
+            std::string path = std::move(job);
+            job.clear();
+            lk.unlock();
+            auto t0 = std::chrono::steady_clock::now();
+            ImageRAM decoded;
+            MappedFile file;
+            bool ok = false;
+            if (!file.open(path.c_str())) std::fprintf(stderr, "%s: cannot map file\n", path.c_str());
+            else ok = decode_image(path.c_str(), file.data(), file.size(), *pool, decoded, false, !hdrOk);
+            file.close();
+            double ms = ms_since(t0);
+            lk.lock();
+            result = std::move(decoded); resultOk = ok; resultMs = ms; done = true;
+        }
+    }
+
+    std::vector<std::string> paths;
+    WorkerPool* pool = nullptr;
+    Uploader* uploader = nullptr;
+    bool hdrOk = false;
+    int maxTexSize = 0;
+
+    // render thread
+    unsigned long slide = 0;                        // the next one to go up
+    State state = State::Idle;
+    ImageRAM img = {};
+    Uploader::Staged staged;
+    Estimate decodeMs = { 250.0 }, stageMs = { 20.0 }, commitMs = { 5.0 };   // until measured
+    double frameMs = 1000.0 / 60;
+    std::chrono::steady_clock::time_point lastTick;
+    unsigned long shown = 0, lateSlides = 0, skipped = 0;
+    long maxLate = 0;
+
+    // shared with the helper thread
+    std::thread helper;
+    std::mutex m;
+    std::condition_variable wake;
+    std::string job;
+    ImageRAM result = {};
+    bool resultOk = false, done = false, quit = false;
+    double resultMs = 0.0;
+};
+
+
+// ------------------------------------------------------ texture atlas
+// Many small images as a few big textures: a skyline packer places them at
+// load time, pages are composited on the pool and uploaded once each, and
+// every image is then just a UV rectangle on its page. Pages carry a short
+// mip chain so quads drawn smaller than their image don't shimmer. Each
+// image sits in a gutter holding copies of its edge pixels, and its cell
+// starts and ends on the grid of the coarsest level's texels, so no level's
+// filtering ever pulls in a neighbour. Pages are always stored top-down.
+struct AtlasRect { int page; float u0, v0, u1, v1; };
+
+// Bottom-left skyline: a list of horizontal segments forming the top edge of
+// everything packed so far. A rectangle goes where it ends up lowest, then
+// leftmost.
+class SkylinePacker {
+public:
+    void reset(int w, int h) { width = w; height = h; sky.assign(1, Segment{0, 0, w}); }
+
+    bool insert(int w, int h, int& outX, int& outY)
+    {
+        int bestY = INT_MAX, bestX = 0; size_t best = SIZE_MAX;
+        for (size_t i = 0; i < sky.size(); ++i) {
+            int y = fit(i, w, h);
+            if (y >= 0 && (y < bestY || (y == bestY && sky[i].x < bestX))) { bestY = y; bestX = sky[i].x; best = i; }
+        }
+        if (best == SIZE_MAX) return false;
+        sky.insert(sky.begin() + best, Segment{bestX, bestY + h, w});
+        // trim what the new segment now covers
+        for (size_t j = best + 1; j < sky.size(); ) {
+            int over = sky[j - 1].x + sky[j - 1].w - sky[j].x;
+            if (over <= 0) break;
+            sky[j].x += over; sky[j].w -= over;
+            if (sky[j].w > 0) break;
+            sky.erase(sky.begin() + j);
+        }
+        for (size_t j = 0; j + 1 < sky.size(); ) {
+            if (sky[j].y == sky[j + 1].y) { sky[j].w += sky[j + 1].w; sky.erase(sky.begin() + j + 1); }
+            else ++j;
+        }
+        used += int64_t(w) * h;
+        outX = bestX; outY = bestY;
+        return true;
+    }
+
+    int used_height() const { int h = 0; for (const Segment& s : sky) h = std::max(h, s.y); return h; }
+    double occupancy() const { return double(used) / (double(width) * std::max(1, used_height())); }
+
+private:
+    struct Segment { int x, y, w; };
+
+    // y a w×h rectangle would rest at with its left edge on segment i, or -1
+    int fit(size_t i, int w, int h) const
+    {
+        if (sky[i].x + w > width) return -1;
+        int y = 0;
+        for (size_t j = i, left = w; left > 0; left -= std::min<size_t>(left, sky[j].w), ++j)
+            y = std::max(y, sky[j].y);
+        return y + h <= height ? y : -1;
+    }
+
+    int width = 0, height = 0;
+    int64_t used = 0;
+    std::vector<Segment> sky;
+};
+
+class TextureAtlas {
+public:
+    // Levels 0..LEVELS-1; at the last one the gutter is a single texel.
+    static constexpr int LEVELS = 5, GUTTER = 1 << (LEVELS - 1);
+
+    // Packs images (8-bit and half-float ones onto separate pages) into pages
+    // of 2048², or as big as a larger image needs, up to maxTex. Each page is
+    // then cut down to the height actually used. Without mipmap (where
+    // GL_TEXTURE_MAX_LEVEL is missing and a short chain can't be complete)
+    // pages are level 0 only.
+    void build(const std::vector<ImageRAM>& images, int maxTex, WorkerPool& pool, bool mipmap)
+    {
+        std::vector<size_t> order(images.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return images[a].h > images[b].h; });
+
+        std::vector<Placement> placed;
+        std::vector<SkylinePacker> packers;
+        for (size_t i : order) {
+            const ImageRAM& img = images[i];
+            int w = cell(img.w), h = cell(img.h), x = 0, y = 0;
+            if (w > maxTex || h > maxTex) { std::fprintf(stderr, "Atlas: %dx%d image is too big for a page\n", img.w, img.h); continue; }
+            int page = 0;
+            for (; page < (int)pages.size(); ++page)
+                if (pages[page].half == img.half && packers[page].insert(w, h, x, y)) break;
+            if (page == (int)pages.size()) {
+                ImageRAM pg; pg.half = img.half;
+                pg.w = std::min(std::max(2048, size_class_dim(w)), maxTex);
+                pg.h = std::min(std::max(2048, size_class_dim(h)), maxTex);
+                packers.emplace_back(); packers.back().reset(pg.w, pg.h);
+                packers.back().insert(w, h, x, y);
+                pages.push_back(std::move(pg));
+            }
+            placed.push_back({i, page, x + GUTTER, y + GUTTER, w, h});
+        }
+
+        rects.assign(images.size(), AtlasRect{-1, 0, 0, 0, 0});
+        for (size_t p = 0; p < pages.size(); ++p) pages[p].h = packers[p].used_height();
+        for (const Placement& pl : placed) {
+            const ImageRAM& img = images[pl.image]; const ImageRAM& pg = pages[pl.page];
+            rects[pl.image] = { pl.page, float(pl.x) / pg.w, float(pl.y) / pg.h,
+                                float(pl.x + img.w) / pg.w, float(pl.y + img.h) / pg.h };
+        }
+
+        for (ImageRAM& pg : pages) pg.rgba.assign(size_t(pg.w) * pg.h * pg.bpp(), 0);
+        pool.run((int)placed.size(), [&](int k) { blit(images[placed[k].image], pages[placed[k].page], placed[k]); });
+
+        size_t separate = 0, packed = 0;
+        for (const ImageRAM& img : images) separate += size_t(size_class_dim(img.w)) * size_class_dim(img.h) * img.bpp();
+        for (const ImageRAM& pg : pages) packed += pg.rgba.size();
+        printf("Atlas: %zu images on %zu page%s (", placed.size(), pages.size(), pages.size() == 1 ? "" : "s");
+        for (size_t p = 0; p < pages.size(); ++p)
+            printf("%s%dx%d%s %.0f%%", p ? ", " : "", pages[p].w, pages[p].h, pages[p].half ? " RGBA16F" : "", packers[p].occupancy() * 100.0);
+        printf(" full), %.1f MB instead of %.1f MB as separate textures\n",
+               packed * 1e-6, separate * 1e-6);
+
+        if (mipmap) for (ImageRAM& pg : pages) build_page_mips(pool, pg);
+    }
+
+    // One upload per page; the CPU copies are dropped afterwards.
+    bool upload(Uploader& uploader)
+    {
+        for (ImageRAM& pg : pages) {
+            GLuint tex = uploader.upload_static(pg);
+            if (!tex) return false;
+            textures.push_back(tex);
+            halfPages.push_back(pg.half);
+            PixelBuffer().swap(pg.rgba);
+        }
+        return true;
+    }
+
+    size_t page_count() const { return textures.size(); }
+    GLuint texture(size_t page) const { return textures[page]; }
+    bool half(size_t page) const { return halfPages[page]; }
+    const std::vector<AtlasRect>& image_rects() const { return rects; }
+
+    // UV rectangles for count quads, cycling through the images on page.
+    std::vector<float> tile_uvs(size_t page, size_t count) const
+    {
+        std::vector<const AtlasRect*> on;
+        for (const AtlasRect& r : rects) if (r.page == (int)page) on.push_back(&r);
+        std::vector<float> uvs;
+        uvs.reserve(count * 4);
+        for (size_t i = 0; i < count && !on.empty(); ++i) {
+            const AtlasRect& r = *on[i % on.size()];
+            uvs.insert(uvs.end(), { r.u0, r.v0, r.u1, r.v1 });
+        }
+        return uvs;
+    }
+
+    void destroy()
+    {
+        if (!textures.empty()) glDeleteTextures((GLsizei)textures.size(), textures.data());
+        textures.clear();
+    }
+
+private:
+    // (x, y) is the image's top-left, w×h its whole cell including gutters.
+    struct Placement { size_t image; int page, x, y, w, h; };
+
+    // An image side plus gutters, rounded up to whole texels of the last
+    // level. Cells are then packed at multiples of GUTTER too, since every
+    // skyline edge is a sum of cell sizes, and the image's last texel at any
+    // level is followed by a whole gutter texel.
+    static int cell(int v) { return (v + 2 * GUTTER + GUTTER - 1) & ~(GUTTER - 1); }
+
+    // Copies img into pg at pl, turning bottom-up rows the right way round and
+    // repeating the edge pixels out to the cell's edges.
+    static void blit(const ImageRAM& img, ImageRAM& pg, const Placement& pl)
+    {
+        size_t bpp = img.bpp(), row = size_t(img.w) * bpp, pitch = size_t(pg.w) * bpp;
+        int right = pl.w - GUTTER - img.w, bottom = pl.h - GUTTER - img.h;
+        size_t span = size_t(pl.w) * bpp;
+        auto dst = [&](int r) { return &pg.rgba[(size_t(pl.y) + r) * pitch + size_t(pl.x) * bpp]; };
+        for (int r = 0; r < img.h; ++r) {
+            unsigned char* d = dst(r);
+            memcpy(d, &img.rgba[size_t(img.bottomUp ? img.h - 1 - r : r) * row], row);
+            for (int g = 1; g <= GUTTER; ++g) memcpy(d - g * bpp, d, bpp);
+            for (int g = 0; g < right; ++g) memcpy(d + row + g * bpp, d + row - bpp, bpp);
+        }
+        for (int g = 1; g <= GUTTER; ++g) memcpy(dst(-g) - GUTTER * bpp, dst(0) - GUTTER * bpp, span);
+        for (int g = 0; g < bottom; ++g) memcpy(dst(img.h + g) - GUTTER * bpp, dst(img.h - 1) - GUTTER * bpp, span);
+    }
+
+    // Filters the page into its chain and keeps the first LEVELS levels; any
+    // further one would mix neighbouring cells.
+    static void build_page_mips(WorkerPool& pool, ImageRAM& pg)
+    {
+        PixelBuffer level0;
+        level0.swap(pg.rgba);
+        if (pg.half) {
+            size_t n = size_t(pg.w) * pg.h * 4;
+            std::vector<float> f(n);
+            const uint16_t* src = (const uint16_t*)level0.data();
+            int parts = (int)std::min<size_t>(pool.lanes(), std::max<size_t>(1, n / (256 * 1024)));
+            pool.run(parts, [&](int p) {
+                for (size_t i = n * p / parts; i < n * (p + 1) / parts; ++i) f[i] = half_to_float(src[i]);
+            });
+            build_mips_half(pool, f.data(), pg.w, pg.h, pg);
+        } else {
+            build_mips(pool, level0.data(), pg.w, pg.h, pg);
+        }
+        if (pg.mip_count() > LEVELS) {
+            pg.levels.resize(LEVELS - 1);
+            pg.rgba.resize(pg.level_offset(LEVELS - 1) + size_t(pg.level_w(LEVELS - 1)) * pg.level_h(LEVELS - 1) * pg.bpp());
+        }
+    }
+
+    std::vector<ImageRAM> pages;
+    std::vector<GLuint> textures;
+    std::vector<bool> halfPages;
+    std::vector<AtlasRect> rects;
+};
+
+
+// ------------------------------------------------------ HDR tonemap
+// RGBA16F textures hold linear radiance; this maps it to the display with
+// Reinhard and a 2.2 gamma. Written against the fixed-function inputs the
+// quad is drawn with.
+static const char* TONEMAP_VS =
+    "#version 110\n"
+    "void main() { gl_TexCoord[0] = gl_MultiTexCoord0; gl_Position = ftransform(); }\n";
+
+static const char* TONEMAP_FS =
+    "#version 110\n"
+    "uniform sampler2D tex;\n"
+    "uniform float exposure;\n"
+    "void main() {\n"
+    "    vec3 c = texture2D(tex, gl_TexCoord[0].st).rgb * exposure;\n"
+    "    c = c / (1.0 + c);\n"
+    "    gl_FragColor = vec4(pow(c, vec3(1.0 / 2.2)), 1.0);\n"
+    "}\n";
+
+static GLuint compile_shader(GLenum type, const char* src)
+{
+    GLuint sh = glCreateShader(type);
+    glShaderSource(sh, 1, &src, nullptr);
+    glCompileShader(sh);
+    GLint ok = 0; glGetShaderiv(sh, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[1024]; glGetShaderInfoLog(sh, sizeof(log), nullptr, log);
+        std::fprintf(stderr, "Shader: %s\n", log);
+        glDeleteShader(sh);
+        return 0;
+    }
+    return sh;
+}
+
+// attribs, if given, is a null-terminated list bound to locations 0, 1, ...
+static GLuint link_program(const char* name, const char* vsSrc, const char* fsSrc, const char* const* attribs = nullptr)
+{
+    GLuint vs = compile_shader(GL_VERTEX_SHADER, vsSrc);
+    GLuint fs = compile_shader(GL_FRAGMENT_SHADER, fsSrc);
+    GLuint prog = 0;
+    if (vs && fs) {
+        prog = glCreateProgram();
+        glAttachShader(prog, vs); glAttachShader(prog, fs);
+        for (GLuint i = 0; attribs && attribs[i]; ++i) glBindAttribLocation(prog, i, attribs[i]);
+        glLinkProgram(prog);
+        GLint ok = 0; glGetProgramiv(prog, GL_LINK_STATUS, &ok);
+        if (!ok) { std::fprintf(stderr, "%s program failed to link\n", name); glDeleteProgram(prog); prog = 0; }
+    }
+    if (vs) glDeleteShader(vs);
+    if (fs) glDeleteShader(fs);
+    return prog;
+}
+
+// Returns 0 if HDR content can't be shown on this context.
+static GLuint create_tonemap_program(const GLCaps& caps)
+{
+    if (!caps.halfFloatTextures || !caps.shaders || caps.es) return 0;
+    GLuint prog = link_program("Tonemap", TONEMAP_VS, TONEMAP_FS);
+    if (prog) {
+        glUseProgram(prog);
+        glUniform1i(glGetUniformLocation(prog, "tex"), 0);
+        glUniform1f(glGetUniformLocation(prog, "exposure"), 1.0f);
+        glUseProgram(0);
+    }
+    return prog;
+}
+
+// The classic quad in immediate mode, in pixels with y down; program is the
+// tonemap for half-float textures, 0 for fixed function.
+static void draw_quad(int dw, int dh, float x, float y, float w, float h, GLuint tex, GLuint program,
+                      float drawU, float vTop, float vBottom)
+{
+    glMatrixMode(GL_PROJECTION); glPushMatrix(); glLoadIdentity(); glOrtho(0, dw, dh, 0, -1, 1);
+    glMatrixMode(GL_MODELVIEW);  glPushMatrix(); glLoadIdentity();
+
+    glEnable(GL_TEXTURE_2D); glBindTexture(GL_TEXTURE_2D, tex);
+    if (program) glUseProgram(program);
+    glBegin(GL_QUADS);
+        glTexCoord2f(0,vTop);        glVertex2f(x,     y);
+        glTexCoord2f(drawU,vTop);    glVertex2f(x + w, y);
+        glTexCoord2f(drawU,vBottom); glVertex2f(x + w, y + h);
+        glTexCoord2f(0,vBottom);     glVertex2f(x,     y + h);
+    glEnd();
+    if (program) glUseProgram(0);
+    glBindTexture(GL_TEXTURE_2D, 0); glDisable(GL_TEXTURE_2D);
+
+    glMatrixMode(GL_MODELVIEW);  glPopMatrix();
+    glMatrixMode(GL_PROJECTION); glPopMatrix();
+}
+
+
+// ------------------------------------------------------ streaming buffer
+// Per-frame vertex/instance data without respecifying buffers: one buffer,
+// persistently and coherently mapped, cut into FRAMES regions. A frame
+// allocates out of its own region and fences it once its draws are queued;
+// begin_frame() only waits on that fence when the region comes round again,
+// FRAMES frames later, by which time the GPU is normally long done with it.
+class StreamBuffer {
+public:
+    static constexpr int FRAMES = 3;
+
+    // False without persistent mapping or fences; callers keep their own path.
+    bool init(const GLCaps& caps, size_t bytesPerFrame)
+    {
+        if (!caps.persistentMapping || !caps.syncObjects) return false;
+        regionSize = (bytesPerFrame + ALIGN - 1) & ~(ALIGN - 1);
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &buf);
+        glBindBuffer(GL_ARRAY_BUFFER, buf);
+        caps.bufferStorageFn(GL_ARRAY_BUFFER, regionSize * FRAMES, nullptr, flags);
+        base = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, regionSize * FRAMES, flags);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        if (!base) { std::fprintf(stderr, "Persistent stream buffer failed to map\n"); destroy(); return false; }
+        return true;
+    }
+
+    void begin_frame()
+    {
+        region = (region + 1) % FRAMES;
+        used = 0;
+        if (GLsync f = fences[region]) {
+            while (glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {}
+            glDeleteSync(f);
+            fences[region] = nullptr;
+        }
+    }
+
+    // CPU pointer for bytes in this frame's region, and its offset in
+    // buffer(); null once the region is full.
+    void* alloc(size_t bytes, size_t& offset)
+    {
+        size_t at = (used + ALIGN - 1) & ~(ALIGN - 1);
+        if (at + bytes > regionSize) return nullptr;
+        used = at + bytes;
+        offset = region * regionSize + at;
+        return base + offset;
+    }
+
+    // Call after the last draw that reads this frame's allocations.
+    void end_frame() { fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0); }
+
+    GLuint buffer() const { return buf; }
+
+    void destroy()
+    {
+        for (GLsync& f : fences) if (f) { glDeleteSync(f); f = nullptr; }
+        if (buf) {
+            if (base) { glBindBuffer(GL_ARRAY_BUFFER, buf); glUnmapBuffer(GL_ARRAY_BUFFER); glBindBuffer(GL_ARRAY_BUFFER, 0); }
+            glDeleteBuffers(1, &buf);
+        }
+        buf = 0; base = nullptr;
+    }
+
+private:
+    static constexpr size_t ALIGN = 64;   // cache line: lanes writing neighbouring allocations never share one
+    GLuint buf = 0;
+    unsigned char* base = nullptr;
+    size_t regionSize = 0, used = 0;
+    int region = FRAMES - 1;
+    GLsync fences[FRAMES] = {};
+};
+
+
+// ------------------------------------------------------ quad system
+// --quads=N: N copies of the current image bouncing independently. State is
+// kept as structure-of-arrays and advanced in SIMD chunks across the pool.
+// The kernels write the new positions straight into the mapped instance
+// buffer as well: xs first, ys right after, each read as its own
+// per-instance attribute. One glDrawArraysInstanced draws the lot.
+typedef std::vector<float, PageAllocator<float>> FloatArray;
+
+// One axis for n quads, reflecting off the edges exactly like the single
+// quad. out, if not null, gets a copy of the new positions.
+typedef void (*BounceFn)(float* p, float* v, float* out, size_t n, float dt, float size, float bound);
+
+struct BounceKernel { const char* name; BounceFn fn; };
+
+static void bounce_scalar(float* p, float* v, float* out, size_t n, float dt, float size, float bound)
+{
+    for (size_t i = 0; i < n; ++i) {
+        p[i] += v[i] * dt;
+        if (p[i] <= 0.0f)         { p[i] = 0.0f;         v[i] =  fabsf(v[i]); }
+        if (p[i] + size >= bound) { p[i] = bound - size; v[i] = -fabsf(v[i]); }
+        if (out) out[i] = p[i];
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Same steps as bounce_scalar, with the two ifs turned into compare masks.
+__attribute__((target("sse2")))
+static void bounce_sse2(float* p, float* v, float* out, size_t n, float dt, float size, float bound)
+{
+    const __m128 zero = _mm_setzero_ps(), sign = _mm_set1_ps(-0.0f);
+    const __m128 vdt = _mm_set1_ps(dt), vsize = _mm_set1_ps(size);
+    const __m128 vbound = _mm_set1_ps(bound), vfar = _mm_set1_ps(bound - size);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 vel = _mm_loadu_ps(v + i);
+        __m128 pos = _mm_add_ps(_mm_loadu_ps(p + i), _mm_mul_ps(vel, vdt));
+        __m128 mag = _mm_andnot_ps(sign, vel);
+        __m128 lo  = _mm_cmple_ps(pos, zero);
+        pos = _mm_andnot_ps(lo, pos);
+        vel = _mm_or_ps(_mm_and_ps(lo, mag), _mm_andnot_ps(lo, vel));
+        __m128 hi  = _mm_cmpge_ps(_mm_add_ps(pos, vsize), vbound);
+        pos = _mm_or_ps(_mm_and_ps(hi, vfar), _mm_andnot_ps(hi, pos));
+        vel = _mm_or_ps(_mm_and_ps(hi, _mm_or_ps(mag, sign)), _mm_andnot_ps(hi, vel));
+        _mm_storeu_ps(p + i, pos);
+        _mm_storeu_ps(v + i, vel);
+        if (out) _mm_storeu_ps(out + i, pos);
+    }
+    bounce_scalar(p + i, v + i, out ? out + i : nullptr, n - i, dt, size, bound);
+}
+
+// Eight at a time: the near edge is a max, the velocity sign comes from the
+// two edge masks. The far edge is a blend rather than a min so a position
+// whose p + size rounds up to the bound still lands exactly on bound - size.
+__attribute__((target("avx2")))
+static void bounce_avx2(float* p, float* v, float* out, size_t n, float dt, float size, float bound)
+{
+    const __m256 zero = _mm256_setzero_ps(), sign = _mm256_set1_ps(-0.0f);
+    const __m256 vdt = _mm256_set1_ps(dt), vsize = _mm256_set1_ps(size);
+    const __m256 vbound = _mm256_set1_ps(bound), vfar = _mm256_set1_ps(bound - size);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 vel = _mm256_loadu_ps(v + i);
+        __m256 pos = _mm256_add_ps(_mm256_loadu_ps(p + i), _mm256_mul_ps(vel, vdt));
+        __m256 lo  = _mm256_cmp_ps(pos, zero, _CMP_LE_OQ);
+        pos = _mm256_max_ps(pos, zero);
+        __m256 hi  = _mm256_cmp_ps(_mm256_add_ps(pos, vsize), vbound, _CMP_GE_OQ);
+        pos = _mm256_blendv_ps(pos, vfar, hi);
+        // sign bit: kept unless an edge was hit, cleared at 0, set at the far edge
+        __m256 s = _mm256_or_ps(_mm256_andnot_ps(_mm256_or_ps(lo, hi), vel), hi);
+        vel = _mm256_or_ps(_mm256_andnot_ps(sign, vel), _mm256_and_ps(s, sign));
+        _mm256_storeu_ps(p + i, pos);
+        _mm256_storeu_ps(v + i, vel);
+        if (out) _mm256_storeu_ps(out + i, pos);
+    }
+    bounce_sse2(p + i, v + i, out ? out + i : nullptr, n - i, dt, size, bound);
+}
+#endif
+
+static std::vector<BounceKernel> available_bounce_kernels()
+{
+    std::vector<BounceKernel> k = { {"scalar", bounce_scalar} };
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) k.push_back({"sse2", bounce_sse2});
+    if (__builtin_cpu_supports("avx2")) k.push_back({"avx2", bounce_avx2});
+#endif
+    return k;
+}
+
+struct QuadSystem {
+    size_t count = 0;
+    float w = 0.0f, h = 0.0f;   // shared by every quad
+    FloatArray x, y, vx, vy;
+    BounceKernel kernel = { "scalar", bounce_scalar };
+
+    // Quads shrink with sqrt(n) so the total covered area stays about the
+    // same as the single quad's, down to 8 px high. Seeded, so runs compare.
+    void init(size_t n, int screenW, int screenH)
+    {
+        count = n;
+        float scale = std::max(1.0f / std::sqrt(float(n)), 8.0f / (screenH * 0.25f));
+        w = screenW * 0.25f * scale; h = screenH * 0.25f * scale;
+        x.resize(n); y.resize(n); vx.resize(n); vy.resize(n);
+        uint32_t seed = 0x9e3779b9u;
+        auto rnd = [&] { seed = seed * 1664525u + 1013904223u; return (seed >> 8) * (1.0f / 16777216.0f); };
+        for (size_t i = 0; i < n; ++i) {
+            x[i] = rnd() * (screenW - w);
+            y[i] = rnd() * (screenH - h);
+            vx[i] = (rnd() < 0.5f ? -250.0f : 250.0f) * (0.5f + rnd());
+            vy[i] = (rnd() < 0.5f ? -190.0f : 190.0f) * (0.5f + rnd());
+        }
+    }
+
+    // Both axes on the pool, in chunks of whole cache lines so no two lanes
+    // share a line of the (write-combined) instance buffer. outX/outY may be
+    // null when there is nothing mapped to write into.
+    void step(WorkerPool& pool, float dt, int boundW, int boundH, float* outX = nullptr, float* outY = nullptr)
+    {
+        const size_t align = 16, minChunk = 16 * 1024;
+        int parts = (int)std::min<size_t>(pool.lanes(), std::max<size_t>(1, count / minChunk));
+        BounceFn fn = kernel.fn; float fw = float(boundW), fh = float(boundH);
+        pool.run(parts, [&](int i) {
+            size_t b = count * i / parts & ~(align - 1), e = i + 1 == parts ? count : count * (i + 1) / parts & ~(align - 1);
+            fn(&x[b], &vx[b], outX ? outX + b : nullptr, e - b, dt, w, fw);
+            fn(&y[b], &vy[b], outY ? outY + b : nullptr, e - b, dt, h, fh);
+        });
+    }
+};
+
+// Times every kernel on a copy of the system, on one lane and on the whole
+// pool, and keeps the fastest for q.
+static void pick_bounce_kernel(WorkerPool& pool, QuadSystem& q, int boundW, int boundH)
+{
+    const int reps = 20;
+    double best = 0.0;
+    std::vector<int> laneCounts = { 1 };
+    if (pool.lanes() > 1) laneCounts.push_back(pool.lanes());
+    for (const BounceKernel& k : available_bounce_kernels()) {
+        for (int lanes : laneCounts) {
+            QuadSystem t = q; t.kernel = k;
+            double sec = 1e30;
+            for (int r = 0; r < reps; ++r) {
+                auto t0 = std::chrono::steady_clock::now();
+                if (lanes == 1) { k.fn(t.x.data(), t.vx.data(), nullptr, t.count, 0.016667f, t.w, float(boundW));
+                                  k.fn(t.y.data(), t.vy.data(), nullptr, t.count, 0.016667f, t.h, float(boundH)); }
+                else t.step(pool, 0.016667f, boundW, boundH);
+                sec = std::min(sec, std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+            }
+            double perMs = q.count / sec * 1e-3;
+            printf("bounce bench %-7s %2d lane%s %10.0f entities/ms\n", k.name, lanes, lanes == 1 ? " " : "s", perMs);
+            if (lanes == pool.lanes() && perMs > best) { best = perMs; q.kernel = k; }
+        }
+    }
+}
+
+static const char* QUADS_VS =
+    "#version 110\n"
+    "attribute vec2 corner;\n"
+    "attribute float instX;\n"
+    "attribute float instY;\n"
+    "attribute vec4 instUv;\n"   // u left, v top, u right, v bottom
+    "uniform vec2 quadSize;\n"
+    "uniform vec2 pixelToNdc;\n"
+    "varying vec2 uv;\n"
+    "void main() {\n"
+    "    vec2 p = vec2(instX, instY) + corner * quadSize;\n"
+    "    uv = mix(instUv.xy, instUv.zw, corner);\n"
+    "    gl_Position = vec4(p * pixelToNdc + vec2(-1.0, 1.0), 0.0, 1.0);\n"
+    "}\n";
+
+static const char* QUADS_FS =
+    "#version 110\n"
+    "uniform sampler2D tex;\n"
+    "uniform bool tonemap;\n"
+    "varying vec2 uv;\n"
+    "void main() {\n"
+    "    vec4 c = texture2D(tex, uv);\n"
+    "    if (tonemap) c = vec4(pow(c.rgb / (1.0 + c.rgb), vec3(1.0 / 2.2)), 1.0);\n"
+    "    gl_FragColor = c;\n"
+    "}\n";
+
+// Instance data lives in the stream buffer where there is one: xs for the
+// frame at some offset, ys capacity floats after. With base instances the
+// attribute pointers never move (xs at 0, ys at capacity) and the offset is
+// passed as the base instance instead, so the VAO is set up once. Without a
+// stream buffer, a plain buffer is orphaned and refilled every frame.
+class QuadRenderer {
+public:
+    // False if this context can't instance; the caller falls back to one quad.
+    bool init(const GLCaps& caps, size_t count)
+    {
+        if (!caps.instancing || caps.es) return false;
+        static const char* const attribs[] = { "corner", "instX", "instY", "instUv", nullptr };
+        prog = link_program("Quads", QUADS_VS, QUADS_FS, attribs);
+        if (!prog) return false;
+        drawInstanced = caps.drawArraysInstanced; attribDivisor = caps.vertexAttribDivisor;
+        drawBaseInstance = caps.drawArraysInstancedBaseInstance;
+        mapRange = caps.mapBufferRange;
+        capacity = count;
+        uQuadSize = glGetUniformLocation(prog, "quadSize");
+        uPixelToNdc = glGetUniformLocation(prog, "pixelToNdc");
+        uTonemap = glGetUniformLocation(prog, "tonemap");
+        glUseProgram(prog);
+        glUniform1i(glGetUniformLocation(prog, "tex"), 0);
+        glUseProgram(0);
+
+        if (caps.gl(3, 0)) glGenVertexArrays(1, &vao);
+        static const float corners[] = { 0, 0,  1, 0,  0, 1,  1, 1 };
+        glGenBuffers(1, &cornerVbo);
+        glBindBuffer(GL_ARRAY_BUFFER, cornerVbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        streamed = stream.init(caps, instance_bytes());
+        if (!streamed) {
+            glGenBuffers(1, &instanceVbo);
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+            glBufferData(GL_ARRAY_BUFFER, instance_bytes(), nullptr, GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        if (vao && streamed && drawBaseInstance) {
+            glBindVertexArray(vao);
+            set_attribs(stream.buffer(), 0);
+            glBindVertexArray(0);
+            fixedAttribs = true;
+        }
+        printf("quads: %zu, instance data %s\n", capacity,
+               !streamed ? "re-uploaded per frame" : fixedAttribs ? "streamed, base instance" : "streamed");
+        return true;
+    }
+
+    // Where the step writes this frame's xs and ys. False when there is
+    // nothing to write into; draw() then uploads q itself.
+    bool map(float*& xs, float*& ys)
+    {
+        xs = ys = nullptr;
+        if (streamed) {
+            stream.begin_frame();
+            xs = (float*)stream.alloc(instance_bytes(), instanceOffset);
+        } else if (mapRange) {
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+            // invalidating orphans last frame's storage instead of waiting on the GPU
+            xs = mapped = (float*)glMapBufferRange(GL_ARRAY_BUFFER, 0, instance_bytes(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            instanceOffset = 0;
+        }
+        if (!xs) return false;
+        ys = xs + capacity;
+        return true;
+    }
+
+    // Per-quad UV rectangles (u0, v0, u1, v1 each), e.g. different images on
+    // one atlas page. Without them every quad shows the rectangle passed to
+    // draw(). Tile rects start at instance 0, which a base instance would
+    // shift, so from here on the instance attributes are re-aimed per frame.
+    void set_tiles(const std::vector<float>& uvs)
+    {
+        if (!tileVbo) glGenBuffers(1, &tileVbo);
+        glBindBuffer(GL_ARRAY_BUFFER, tileVbo);
+        glBufferData(GL_ARRAY_BUFFER, capacity * 4 * sizeof(float), nullptr, GL_STATIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, std::min(uvs.size(), capacity * 4) * sizeof(float), uvs.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        if (fixedAttribs && vao) { glBindVertexArray(vao); unset_attribs(); glBindVertexArray(0); }
+        fixedAttribs = false;
+    }
+
+    void draw(const QuadSystem& q, int dw, int dh, GLuint tex, bool half, float drawU, float vTop, float vBottom)
+    {
+        size_t n = std::min(q.count, capacity);
+        if (!streamed) {
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+            bool written = mapped && glUnmapBuffer(GL_ARRAY_BUFFER);   // false: storage was lost, upload again
+            mapped = nullptr;
+            if (!written) {
+                glBufferData(GL_ARRAY_BUFFER, instance_bytes(), nullptr, GL_STREAM_DRAW);
+                glBufferSubData(GL_ARRAY_BUFFER, 0, n * sizeof(float), q.x.data());
+                glBufferSubData(GL_ARRAY_BUFFER, capacity * sizeof(float), n * sizeof(float), q.y.data());
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+
+        if (vao) glBindVertexArray(vao);
+        if (!fixedAttribs) set_attribs(streamed ? stream.buffer() : instanceVbo, instanceOffset);
+        glUseProgram(prog);
+        glUniform2f(uQuadSize, q.w, q.h);
+        glUniform2f(uPixelToNdc, 2.0f / dw, -2.0f / dh);
+        if (!tileVbo) glVertexAttrib4f(3, 0.0f, vTop, drawU, vBottom);
+        glUniform1i(uTonemap, half);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        if (fixedAttribs) drawBaseInstance(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)n, GLuint(instanceOffset / sizeof(float)));
+        else              drawInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)n);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glUseProgram(0);
+        if (!fixedAttribs) unset_attribs();
+        if (vao) glBindVertexArray(0);
+        if (streamed) stream.end_frame();
+    }
+
+    void destroy()
+    {
+        stream.destroy();
+        if (prog) glDeleteProgram(prog);
+        if (cornerVbo) glDeleteBuffers(1, &cornerVbo);
+        if (instanceVbo) glDeleteBuffers(1, &instanceVbo);
+        if (tileVbo) glDeleteBuffers(1, &tileVbo);
+        if (vao) glDeleteVertexArrays(1, &vao);
+        prog = cornerVbo = instanceVbo = tileVbo = vao = 0;
+    }
+
+private:
+    size_t instance_bytes() const { return capacity * 2 * sizeof(float); }
+
+    void set_attribs(GLuint instances, size_t xOffset)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instances);
+        glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 0, (const void*)xOffset);
+        glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 0, (const void*)(xOffset + capacity * sizeof(float)));
+        glEnableVertexAttribArray(1); attribDivisor(1, 1);
+        glEnableVertexAttribArray(2); attribDivisor(2, 1);
+        if (tileVbo) {
+            glBindBuffer(GL_ARRAY_BUFFER, tileVbo);
+            glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, (const void*)0);
+            glEnableVertexAttribArray(3); attribDivisor(3, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, cornerVbo);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (const void*)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void unset_attribs()
+    {
+        for (GLuint i = 0; i < 4; ++i) { glDisableVertexAttribArray(i); if (i) attribDivisor(i, 0); }
+    }
+
+    PFNGLDRAWARRAYSINSTANCEDPROC drawInstanced = nullptr;
+    PFNGLVERTEXATTRIBDIVISORPROC attribDivisor = nullptr;
+    PFNGLDRAWARRAYSINSTANCEDBASEINSTANCEPROC drawBaseInstance = nullptr;
+    StreamBuffer stream;
+    bool streamed = false, fixedAttribs = false, mapRange = false;
+    float* mapped = nullptr;
+    size_t instanceOffset = 0;
+    GLuint prog = 0, vao = 0, cornerVbo = 0, instanceVbo = 0, tileVbo = 0;
+    GLint uQuadSize = -1, uPixelToNdc = -1, uTonemap = -1;
+    size_t capacity = 0;
+};
+
+
+// ------------------------------------------------------ multi-display
+// --all-displays: a fullscreen window on every display, each drawn by a
+// thread of its own with its own context and vsync, so a display that misses
+// frames never holds the others back. The contexts share objects with the
+// first one, so the playlist is uploaded once, as static textures, and they
+// all draw from it; a context the driver won't share streams the slides
+// through an Uploader of its own instead. The displays stay in step by
+// taking the slide and the colour wave from one shared clock, not from
+// their own frame counts.
+
+struct FrameStats {
+    unsigned long frames = 0, late = 0;
+    double seconds = 0.0, worstMs = 0.0;
+
+    void add(double ms, double lateMs)
+    {
+        ++frames; seconds += ms * 1e-3;
+        worstMs = std::max(worstMs, ms);
+        if (ms > lateMs) ++late;
+    }
+    void print(int display, const char* what) const
+    {
+        printf("display %d %s: %.1f fps, worst %.1f ms, %lu of %lu frames late\n",
+               display, what, seconds > 0.0 ? frames / seconds : 0.0, worstMs, late, frames);
+    }
+};
+
+struct DisplayOutput {
+    int index = 0;
+    SDL_Window* win = nullptr;
+    SDL_GLContext ctx = nullptr;
+    int refreshHz = 60;
+    bool shared = false;        // sees the first context's textures
+    FrameStats total;
+    std::thread thread;
+};
+
+// Frame 100 and every 200 frames after it, as in the single-display loop at 60 Hz.
+static constexpr double SLIDE_FIRST_S = 100 / 60.0, SLIDE_S = 200 / 60.0;
+
+static void run_display(DisplayOutput& d, const std::vector<ImageRAM>& images, const std::vector<Slide>& slides,
+                        std::chrono::steady_clock::time_point start, const std::atomic<bool>& running)
+{
+    using clock = std::chrono::steady_clock;
+    SDL_GL_MakeCurrent(d.win, d.ctx);
+    SDL_GL_SetSwapInterval(1);
+    GLCaps caps = probe_gl_caps();
+    GLuint tonemap = create_tonemap_program(caps);
+
+    WorkerPool copyPool(0);
+    Uploader uploader;
+    if (!d.shared && !images.empty()) {
+        uploader.init(caps, copyPool);
+        for (const ImageRAM& img : images) uploader.prepare(img);
+    }
+
+    int dw, dh; SDL_GL_GetDrawableSize(d.win, &dw, &dh);
+    float quadW = dw * 0.25f, quadH = dh * 0.25f;
+    float posX = (dw - quadW) * 0.5f, posY = (dh - quadH) * 0.5f;
+    float velX = 250.0f, velY = 190.0f;
+
+    size_t currentIdx = SIZE_MAX;
+    Slide slide = {};
+    const double lateMs = 1500.0 / d.refreshHz;   // missed at least one vblank
+    FrameStats recent;
+    clock::time_point last = clock::now(), reported = last;
+    bool first = true;
+    while (running.load(std::memory_order_relaxed)) {
+        clock::time_point now = clock::now();
+        double ms = std::chrono::duration<double, std::milli>(now - last).count();
+        float dt = first ? 0.0f : float(std::min(ms, 100.0) * 1e-3);
+        if (!first) { recent.add(ms, lateMs); d.total.add(ms, lateMs); }
+        last = now; first = false;
+        if (now - reported >= std::chrono::seconds(5)) { recent.print(d.index, "last 5 s"); recent = FrameStats(); reported = now; }
+
+        float t = std::chrono::duration<float>(now - start).count();
+        SDL_GL_GetDrawableSize(d.win, &dw, &dh);
+        glViewport(0, 0, dw, dh);
+        glClearColor(0.5f + 0.5f * std::sin(t), 0.5f + 0.5f * std::sin(t + 2.094395f), 0.5f + 0.5f * std::sin(t + 4.188790f), 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        if (t >= SLIDE_FIRST_S && !images.empty()) {
+            size_t idx = size_t((t - SLIDE_FIRST_S) / SLIDE_S) % images.size();
+            if (idx != currentIdx) {
+                currentIdx = idx;
+                if (d.shared) slide = slides[idx];
+                else {
+                    const ImageRAM& img = images[idx];
+                    SizeClass& c = uploader.upload(img);
+                    float drawV = float(img.h) / c.h;
+                    slide = { c.tex[c.front], img.half, float(img.w) / c.w, img.bottomUp ? drawV : 0.0f, img.bottomUp ? 0.0f : drawV };
+                }
+            }
+            bounce_scalar(&posX, &velX, nullptr, 1, dt, quadW, dw);
+            bounce_scalar(&posY, &velY, nullptr, 1, dt, quadH, dh);
+            draw_quad(dw, dh, posX, posY, quadW, quadH, slide.tex, slide.half ? tonemap : 0, slide.drawU, slide.vTop, slide.vBottom);
+        }
+
+        SDL_GL_SwapWindow(d.win);
+    }
+
+    for (const ImageRAM& img : images) uploader.unpin(img);
+    if (tonemap) glDeleteProgram(tonemap);
+    glFinish();
+    SDL_GL_MakeCurrent(d.win, nullptr);
+}
+
+static int run_all_displays(const LoadOptions& load)
+{
+    int count = SDL_GetNumVideoDisplays();
+    if (count < 1) { std::fprintf(stderr, "SDL_GetNumVideoDisplays: %s\n", SDL_GetError()); return EXIT_FAILURE; }
+    std::vector<DisplayOutput> displays(count);
+
+    // The first display's context owns the playlist.
+    DisplayOutput& primary = displays[0];
+    if (!init_sdl(1920, 1080, &primary.win, &primary.ctx, 0)) return EXIT_FAILURE;
+    primary.shared = true;
+    GLCaps caps = probe_gl_caps();
+    print_gl_caps(caps);
+
+    GLuint tonemap = create_tonemap_program(caps);
+    LoadOptions decodeOpt = load;
+    decodeOpt.hdrToRgba8 = tonemap == 0;
+    std::vector<ImageRAM> images;
+    {
+        WorkerPool decodePool(default_worker_count(16));
+        stbi_set_parallel_for(stbi_run_on_pool, &decodePool);
+        images = load_images_to_ram(decodePool, decodeOpt);
+        stbi_set_parallel_for(nullptr, nullptr);
+    }
+    GLint maxTex = 0; glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTex);
+    drop_unshowable(images, maxTex);
+    if (tonemap) glDeleteProgram(tonemap);
+
+    WorkerPool copyPool(default_worker_count());
+    Uploader uploader;
+    uploader.init(caps, copyPool);
+    std::vector<Slide> slides;
+    for (const ImageRAM& img : images) {
+        Slide s = { uploader.upload_static(img), img.half, 1.0f, img.bottomUp ? 1.0f : 0.0f, img.bottomUp ? 0.0f : 1.0f };
+        if (!s.tex) { std::fprintf(stderr, "Upload of %dx%d image failed\n", img.w, img.h); return EXIT_FAILURE; }
+        slides.push_back(s);
+    }
+    glFinish();   // other contexts only see finished uploads
+
+    for (int i = 0; i < count; ++i) {
+        DisplayOutput& d = displays[i];
+        d.index = i;
+        SDL_DisplayMode mode;
+        if (SDL_GetDesktopDisplayMode(i, &mode) == 0 && mode.refresh_rate > 0) d.refreshHz = mode.refresh_rate;
+        if (i == 0) continue;
+        SDL_GL_MakeCurrent(primary.win, primary.ctx);
+        SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+        if (!init_sdl(1920, 1080, &d.win, &d.ctx, i)) return EXIT_FAILURE;
+        d.shared = slides.empty() || glIsTexture(slides[0].tex);
+        SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+        printf("display %d: %s, %d Hz, %s\n", i, SDL_GetDisplayName(i), d.refreshHz,
+               d.shared ? "shared textures" : "no context sharing, uploading its own");
+    }
+    SDL_GL_MakeCurrent(primary.win, nullptr);
+
+    std::atomic<bool> running{true};
+    auto start = std::chrono::steady_clock::now();
+    for (DisplayOutput& d : displays)
+        d.thread = std::thread(run_display, std::ref(d), std::cref(images), std::cref(slides), start, std::cref(running));
+
+    while (running) {
+        SDL_Event ev; while (SDL_PollEvent(&ev)) {
+            if (ev.type == SDL_QUIT) running = false;
+            if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_ESCAPE) running = false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    for (DisplayOutput& d : displays) { d.thread.join(); d.total.print(d.index, "overall"); }
+
+    SDL_GL_MakeCurrent(primary.win, primary.ctx);
+    for (const Slide& s : slides) glDeleteTextures(1, &s.tex);
+    for (int i = count - 1; i >= 0; --i) { SDL_GL_DeleteContext(displays[i].ctx); SDL_DestroyWindow(displays[i].win); }
+    SDL_Quit();
+    return 0;
+}
+
+
+// ------------------------------------------------------ main
+struct RunOptions {
+    LoadOptions load;
+    const char* gifPath = nullptr;
+    int quads = 0;              // 0: the single classic quad
+    bool allDisplays = false;   // a window and render thread per display
+    const char* shmName = nullptr;  // frames from a shmproducer-style ring
+    bool prefetch = false;      // decode and upload each slide just in time
+};
+
+// [--io=mmap|uring|pread] [--qd=N] [--packed] [--prefetch] [--quads=N] [--all-displays] [--shm=NAME] [image directory | animated GIF]
+static bool parse_args(int argc, char** argv, RunOptions& opt)
+{
+    LoadOptions& load = opt.load;
+    for (int i = 1; i < argc; ++i) {
+        const char* a = argv[i];
+        struct stat st;
+        if      (!std::strcmp(a, "--io=mmap"))  load.io = FileIo::Mmap;
+        else if (!std::strcmp(a, "--io=uring")) load.io = FileIo::Uring;
+        else if (!std::strcmp(a, "--io=pread")) load.io = FileIo::Pread;
+        else if (!std::strncmp(a, "--qd=", 5) && std::atoi(a + 5) > 0) load.queueDepth = std::atoi(a + 5);
+        else if (!std::strncmp(a, "--quads=", 8) && std::atoi(a + 8) > 0) opt.quads = std::atoi(a + 8);
+        else if (!std::strcmp(a, "--packed"))  load.packed = true;
+        else if (!std::strcmp(a, "--prefetch")) opt.prefetch = true;
+        else if (!std::strcmp(a, "--all-displays")) opt.allDisplays = true;
+        else if (!std::strncmp(a, "--shm=", 6) && a[6]) opt.shmName = a + 6;
+        else if (a[0] == '-') { std::fprintf(stderr, "usage: %s [--io=mmap|uring|pread] [--qd=N] [--packed] [--prefetch] [--quads=N] [--all-displays] [--shm=NAME] [dir | anim.gif]\n", argv[0]); return false; }
+        else if (stat(a, &st) == 0 && S_ISDIR(st.st_mode)) load.dir = a;
+        else opt.gifPath = a;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    constexpr int START_W = 1920;
+    constexpr int START_H = 1080;
+
+    RunOptions opt;
+    if (!parse_args(argc, argv, opt)) return EXIT_FAILURE;
+    if (opt.allDisplays) {
+        if (opt.gifPath || opt.quads || opt.shmName || opt.prefetch)
+            std::fprintf(stderr, "--all-displays shows the classic quad; GIFs, --quads, --shm and --prefetch are single display only\n");
+        if (!opt.gifPath && !opt.shmName && !opt.prefetch) return run_all_displays(opt.load);
+    }
+
+    SDL_Window* win = nullptr; SDL_GLContext ctx = nullptr;
+    if (!init_sdl(START_W, START_H, &win, &ctx)) return EXIT_FAILURE;
+    
+    GLCaps caps = probe_gl_caps();
+    print_gl_caps(caps);
+    GLuint tonemap = create_tonemap_program(caps);
+    opt.load.hdrToRgba8 = tonemap == 0;
+
+    WorkerPool decodePool(default_worker_count(16));
+    stbi_set_parallel_for(stbi_run_on_pool, &decodePool);
+    GifSource gif;
+    ShmRing ring;
+    std::vector<ImageRAM> images;
+    std::vector<std::string> prefetchPaths;
+    if (opt.shmName)       { if (!ring.open(opt.shmName)) return EXIT_FAILURE; }
+    else if (opt.gifPath)  { if (!gif.open(opt.gifPath)) return EXIT_FAILURE; }
+    else if (opt.prefetch) prefetchPaths = find_playlist(opt.load.dir);
+    else                   images = load_images_to_ram(decodePool, opt.load);
+
+    GLint maxTex = 0; glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTex);
+    if (gif.is_open() && (gif.width() > maxTex || gif.height() > maxTex)) {
+        std::fprintf(stderr, "%dx%d GIF exceeds GL_MAX_TEXTURE_SIZE %d\n", gif.width(), gif.height(), maxTex);
+        return EXIT_FAILURE;
+    }
+    if (ring.is_open() && (ring.width() > maxTex || ring.height() > maxTex)) {
+        std::fprintf(stderr, "%dx%d shared-memory frames exceed GL_MAX_TEXTURE_SIZE %d\n", ring.width(), ring.height(), maxTex);
+        return EXIT_FAILURE;
+    }
+    drop_unshowable(images, maxTex);
+
+    WorkerPool copyPool(default_worker_count());
+    Uploader uploader;
+    uploader.init(caps, copyPool);
+
+    QuadSystem quads;
+    QuadRenderer quadRenderer;
+    if (opt.quads > 0) {
+        // the physics shares copyPool: uploads and steps both run on this thread, never at once
+        if (quadRenderer.init(caps, opt.quads)) { quads.init(opt.quads, START_W, START_H); pick_bounce_kernel(copyPool, quads, START_W, START_H); }
+        else std::fprintf(stderr, "No instanced drawing on this context, showing a single quad\n");
+    }
+
+    // With many quads on screen a playlist becomes an atlas, so the quads can
+    // all show different images with one bind and one draw; its pages take
+    // the place of the images in the slideshow.
+    TextureAtlas atlas;
+    if (quads.count && images.size() > 1 && opt.load.packed) {   // pages are composited from raw pixels
+        printf("Atlas: off with --packed, cycling images instead\n");
+    } else if (quads.count && images.size() > 1) {
+        atlas.build(images, maxTex, decodePool, !caps.es || caps.gles(3, 0));
+        if (atlas.upload(uploader)) images.clear();
+        else { std::fprintf(stderr, "Atlas upload failed, cycling images instead\n"); atlas.destroy(); }
+    }
+    for (const ImageRAM& img : images) uploader.prepare(img);
+    // GIF slots are rewritten while an upload from them may still be in
+    // flight, so they go through the PBO ring rather than being pinned.
+    if (gif.is_open()) uploader.class_for(gif.width(), gif.height());
+    if (ring.is_open()) printf("Shared memory %s: %dx%d, %d slots\n", opt.shmName, ring.width(), ring.height(), ring.slots());
+
+    Prefetcher prefetch;
+    if (opt.prefetch && !opt.gifPath && !opt.shmName) prefetch.start(std::move(prefetchPaths), decodePool, uploader, tonemap != 0, maxTex);
+
+    // A loaded playlist follows its directory; atlas pages are packed once.
+    DirWatcher watcher;
+    if (atlas.page_count() && !opt.gifPath && !opt.shmName && !opt.prefetch)
+        printf("Atlas: not watching %s for changes\n", opt.load.dir ? opt.load.dir : ".");
+    else if (!opt.gifPath && !opt.shmName && !opt.prefetch && watcher.start(opt.load, decodePool))
+        std::cout << "Watching " << (opt.load.dir ? opt.load.dir : ".") << " for changes" << std::endl;
+
+
+    size_t currentIdx = SIZE_MAX; // force first upload
+    double gifClockMs = 0.0, gifDueMs = 0.0;   // GIF playback time, next frame's start
+    ShmIngestStats shmStats;
+    UploadStats uploadStats;
+    uint64_t shmShown = 0;                      // last ring frame uploaded
+
+    // DVD‑style bouncing physics
+    float quadW = START_W * 0.25f, quadH = START_H * 0.25f;
+    float posX  = (START_W - quadW) * 0.5f;
+    float posY  = (START_H - quadH) * 0.5f;
+    float velX  = 250.0f;   // px/s – tuned for 1080p
+    float velY  = 190.0f;
+    
+    GLuint drawingTexture = 0;
+    bool drawingHalf = false;
+    float drawU = 1.0f;                 // image extent inside its size class,
+    float vTop = 0.0f, vBottom = 1.0f;  // with v swapped for bottom-up images
+
+    unsigned long frame = 0;
+    bool running = true;
+    float time = 0.0f;
+    float alwaysDT = 0.01666f;
+    while (running) {
+        SDL_Event ev; while (SDL_PollEvent(&ev)) {
+            if (ev.type == SDL_QUIT) running = false;
+            if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_ESCAPE) running = false;
+        }
+
+        ReloadBatch reload;
+        if (watcher.take(reload)) {
+            std::string shown = currentIdx < images.size() ? images[currentIdx].path : std::string();
+            bool shownChanged = std::find(reload.changed.begin(), reload.changed.end(), shown) != reload.changed.end();
+            drop_unshowable(reload.decoded, maxTex);
+            merge_reload(images, reload, [&](const ImageRAM& img) { uploader.unpin(img); });
+            for (const ImageRAM& img : images) uploader.prepare(img);
+            // The texture on screen is stale if its image changed or another one took its index.
+            if (shownChanged || currentIdx >= images.size() || images[currentIdx].path != shown) currentIdx = SIZE_MAX;
+        }
+
+        time += 0.016667f;
+        float dt = alwaysDT;
+
+        // Background colour wave
+        float t = time;
+        float rc = 0.5f + 0.5f * std::sin(t);
+        float gc = 0.5f + 0.5f * std::sin(t + 2.094395f);
+        float bc = 0.5f + 0.5f * std::sin(t + 4.188790f);
+
+        int dw, dh; SDL_GL_GetDrawableSize(win, &dw, &dh);
+        glViewport(0, 0, dw, dh);
+        glClearColor(rc, gc, bc, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        Slide prefetched;
+        if (prefetch.tick(frame, prefetched)) {
+            drawingTexture = prefetched.tex;
+            drawingHalf = prefetched.half;
+            drawU = prefetched.drawU; vTop = prefetched.vTop; vBottom = prefetched.vBottom;
+        }
+
+        if (frame >= 100 && (gif.is_open() || ring.is_open() || prefetch.active() || !images.empty() || atlas.page_count())) {
+            const ImageRAM* next = nullptr;
+            if (ring.is_open()) {
+                // Newest complete frame only; anything the producer wrote
+                // in between is dropped rather than queued.
+                uint64_t n = ring.latest();
+                if (n != shmShown && ring.intact(n)) {
+                    SizeClass& c = uploader.class_for(ring.width(), ring.height());
+                    bool ok = uploader.upload_external(c, ring.width(), ring.height(), ring.frame(n), [&] { return ring.intact(n); });
+                    if (ok) {
+                        drawingTexture = c.tex[c.front];
+                        drawingHalf = false;
+                        drawU = float(ring.width()) / c.w;
+                        vTop = 0.0f; vBottom = float(ring.height()) / c.h;
+                    }
+                    shmStats.add(n, shmShown, ok, ok ? shm_ring_now_ns() - ring.published_ns(n) : 0);
+                    if (ok) shmShown = n;
+                }
+            } else if (gif.is_open()) {
+                if (gifClockMs >= gifDueMs) {
+                    int delayMs = 0;
+                    next = gif.next(delayMs);
+                    gifDueMs = next ? std::max(gifDueMs + delayMs, gifClockMs) : HUGE_VAL;
+                }
+                gifClockMs += dt * 1000.0;
+            } else if (atlas.page_count()) {
+                size_t page = ((frame - 100) / 200) % atlas.page_count();
+                if (page != currentIdx) {
+                    currentIdx = page;
+                    drawingTexture = atlas.texture(page);
+                    drawingHalf = atlas.half(page);
+                    quadRenderer.set_tiles(atlas.tile_uvs(page, quads.count));
+                }
+            } else if (!images.empty()) {
+                size_t newIdx = ((frame - 100) / 200) % images.size();
+                if (newIdx != currentIdx) { next = &images[newIdx]; currentIdx = newIdx; }
+            }
+            if (next) {
+                const ImageRAM& img = *next;
+                auto start = std::chrono::steady_clock::now();
+                SizeClass& c = uploader.upload(img);
+                uploadStats.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+                drawingTexture = c.tex[c.front];
+                drawingHalf = img.half;
+                float drawV = float(img.h) / c.h;
+                drawU = float(img.w) / c.w;
+                vTop = img.bottomUp ? drawV : 0.0f; vBottom = img.bottomUp ? 0.0f : drawV;
+            }
+
+            if (quads.count) {
+                float *xs, *ys;
+                quadRenderer.map(xs, ys);
+                quads.step(copyPool, dt, dw, dh, xs, ys);
+                quadRenderer.draw(quads, dw, dh, drawingTexture, drawingHalf, drawU, vTop, vBottom);
+            } else {
+                bounce_scalar(&posX, &velX, nullptr, 1, dt, quadW, dw);
+                bounce_scalar(&posY, &velY, nullptr, 1, dt, quadH, dh);
+                draw_quad(dw, dh, posX, posY, quadW, quadH, drawingTexture, drawingHalf ? tonemap : 0, drawU, vTop, vBottom);
+            }
         }
 
         SDL_GL_SwapWindow(win);
@@ -303,6 +3572,13 @@ int main()
     }
 
     //glDeleteTextures(1, texIDs);
+    if (ring.is_open()) shmStats.report();
+    prefetch.report();
+    uploadStats.report();
+    for (const ImageRAM& img : images) uploader.unpin(img);
+    if (tonemap) glDeleteProgram(tonemap);
+    quadRenderer.destroy();
+    atlas.destroy();
     SDL_GL_DeleteContext(ctx); SDL_DestroyWindow(win); SDL_Quit();
     return 0;
 }
@@ -0,0 +1,76 @@
+/*
+ * shmproducer.cpp – test source for pbotest --shm=NAME
+ *
+ * Writes a scrolling test pattern into a shmring.h frame ring as fast as it
+ * can, or at a fixed rate, and prints its own frame rate and write bandwidth
+ * once a second. pbotest reports the other end: frames shown, dropped and
+ * torn, and the latency from publish to upload.
+ *
+ * Build:
+ *   g++ shmproducer.cpp -std=c++17 -O2 -Wall -o shmproducer
+ * Run:
+ *   ./shmproducer /pbotest 1920 1080 [fps] [slots]   (fps 0: unthrottled)
+ *   ./pbotest --shm=/pbotest
+ */
+
+#include "shmring.h"
+#include <csignal>
+#include <cstdlib>
+#include <thread>
+
+static volatile std::sig_atomic_t stop = 0;
+
+static void on_signal(int) { stop = 1; }
+
+// Diagonal colour bands moving with the frame number, plus a white bar
+// whose row is n % h, so tearing and dropped frames are visible on screen.
+static void draw_pattern(unsigned char* px, int w, int h, uint64_t n)
+{
+    for (int y = 0; y < h; ++y) {
+        uint32_t* row = (uint32_t*)(px + size_t(y) * w * 4);
+        if (uint64_t(y) / 8 == (n * 4 % h) / 8) { for (int x = 0; x < w; ++x) row[x] = 0xffffffffu; continue; }
+        for (int x = 0; x < w; ++x) {
+            uint32_t v = uint32_t(x + y + n * 8);
+            row[x] = 0xff000000u | ((v & 0xff) << 16) | (((v >> 2) & 0xff) << 8) | ((v >> 4) & 0xff);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4) { std::fprintf(stderr, "usage: %s NAME width height [fps] [slots]\n", argv[0]); return EXIT_FAILURE; }
+    const char* name = argv[1];
+    int w = std::atoi(argv[2]), h = std::atoi(argv[3]);
+    double fps = argc > 4 ? std::atof(argv[4]) : 60.0;
+    int slots = argc > 5 ? std::atoi(argv[5]) : 3;
+
+    ShmRing ring;
+    if (!ring.create(name, w, h, slots)) return EXIT_FAILURE;
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    std::printf("%s: %dx%d RGBA8, %d slots, %s\n", name, w, h, slots, fps > 0 ? "throttled" : "unthrottled");
+
+    typedef std::chrono::steady_clock clock;
+    const auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(fps > 0 ? 1.0 / fps : 0.0));
+    clock::time_point due = clock::now(), reported = due;
+    uint64_t n = 0, sinceReport = 0;
+    double writeSeconds = 0.0;
+    while (!stop) {
+        ++n;
+        auto t0 = clock::now();
+        draw_pattern(ring.begin_write(n), w, h, n);
+        ring.end_write(n);
+        writeSeconds += std::chrono::duration<double>(clock::now() - t0).count();
+        ++sinceReport;
+
+        if (fps > 0) { due += period; std::this_thread::sleep_until(due); }
+        auto now = clock::now();
+        if (now - reported >= std::chrono::seconds(1)) {
+            double s = std::chrono::duration<double>(now - reported).count();
+            std::printf("%llu frames, %.1f fps, writing at %.2f GB/s\n", (unsigned long long)n, sinceReport / s,
+                        sinceReport * double(w) * h * 4 / writeSeconds * 1e-9);
+            reported = now; sinceReport = 0; writeSeconds = 0.0;
+        }
+    }
+    return 0;   // ~ShmRing unlinks the name
+}
@@ -0,0 +1,169 @@
+/*
+ * shmring.h – frames from another process through POSIX shared memory
+ *
+ * One producer writes RGBA8 frames (top-down, tightly packed rows) into a
+ * ring of slots in a shm_open() object; any number of readers map it read
+ * only and take the newest complete frame. Nothing blocks: each slot carries
+ * a sequence number, 2n while it holds complete frame n and 2n-1 while frame
+ * n is being written over it, and the header publishes the newest complete
+ * n. A reader copies a slot out and then checks its number again; if the
+ * producer came round to that slot during the copy, the frame is torn and
+ * dropped. With three or more slots that takes the producer lapping the
+ * reader twice within one copy.
+ *
+ * The reader's copy is a plain memcpy (or the GL driver's own, reading
+ * straight from the mapping) racing the producer's stores, which the C++
+ * memory model calls a data race however it is fenced. It relies on what
+ * x86 and ARM actually do: a racy load returns some mix of old and new
+ * bytes, and the sequence check afterwards throws that frame away. Copying
+ * through relaxed atomic words would make it well defined but could not
+ * feed glTexSubImage2D's client-memory path.
+ *
+ * Used by pbotest (--shm=NAME) and shmproducer.cpp.
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+constexpr uint32_t SHM_RING_MAGIC = 0x474e5250;     // "PRNG"
+constexpr uint32_t SHM_RING_VERSION = 1;
+constexpr int SHM_RING_MAX_SLOTS = 8;
+constexpr size_t SHM_RING_PAGE = 4096;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the ring needs address-free 64-bit atomics");
+
+struct ShmSlot {
+    std::atomic<uint64_t> seq;          // 2n: holds frame n, 2n-1: frame n being written
+    uint64_t publishedNs;               // steady clock when frame n was completed
+    uint64_t pad[6];
+};
+
+struct ShmRingHeader {
+    uint32_t magic, version;
+    uint32_t width, height;
+    uint32_t slots, pad0;
+    uint64_t slotBytes;                 // stride between slots, whole pages
+    uint64_t dataOffset;                // first slot, page aligned
+    alignas(64) std::atomic<uint64_t> published;   // newest complete frame, 0 before the first
+    alignas(64) ShmSlot slot[SHM_RING_MAX_SLOTS];
+};
+
+static uint64_t shm_ring_now_ns()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class ShmRing {
+public:
+    ShmRing() = default;
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+    ~ShmRing() { close(); }
+
+    // Producer side: creates (or replaces) the object and owns its name.
+    bool create(const char* name, int w, int h, int slots)
+    {
+        if (w <= 0 || h <= 0 || slots < 2 || slots > SHM_RING_MAX_SLOTS) { std::fprintf(stderr, "%s: bad ring geometry\n", name); return false; }
+        uint64_t slotBytes = (uint64_t(w) * h * 4 + SHM_RING_PAGE - 1) & ~uint64_t(SHM_RING_PAGE - 1);
+        uint64_t dataOffset = (sizeof(ShmRingHeader) + SHM_RING_PAGE - 1) & ~uint64_t(SHM_RING_PAGE - 1);
+        size_t bytes = dataOffset + slotBytes * slots;
+
+        shm_unlink(name);
+        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd < 0) { std::perror(name); return false; }
+        if (ftruncate(fd, (off_t)bytes) < 0) { std::perror(name); ::close(fd); shm_unlink(name); return false; }
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) { std::perror(name); shm_unlink(name); return false; }
+
+        base = (unsigned char*)p; size = bytes; owner = true;
+        std::snprintf(ownedName, sizeof(ownedName), "%s", name);
+        hdr = (ShmRingHeader*)p;      // ftruncate zero-filled it: every seq and published start at 0
+        hdr->version = SHM_RING_VERSION;
+        hdr->width = w; hdr->height = h; hdr->slots = slots;
+        hdr->slotBytes = slotBytes; hdr->dataOffset = dataOffset;
+        std::atomic_thread_fence(std::memory_order_release);
+        hdr->magic = SHM_RING_MAGIC;    // last: readers check it before the rest
+        return true;
+    }
+
+    // Reader side, read only.
+    bool open(const char* name)
+    {
+        int fd = shm_open(name, O_RDONLY, 0);
+        if (fd < 0) { std::perror(name); return false; }
+        struct stat st;
+        if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(ShmRingHeader)) { std::fprintf(stderr, "%s: not a frame ring\n", name); ::close(fd); return false; }
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) { std::perror(name); return false; }
+        base = (unsigned char*)p; size = st.st_size;
+        hdr = (ShmRingHeader*)p;
+
+        bool ok = hdr->magic == SHM_RING_MAGIC && hdr->version == SHM_RING_VERSION;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        ok = ok && hdr->slots >= 2 && hdr->slots <= SHM_RING_MAX_SLOTS && hdr->width && hdr->height
+                && hdr->slotBytes >= uint64_t(hdr->width) * hdr->height * 4
+                && hdr->dataOffset + hdr->slotBytes * hdr->slots <= size;
+        if (!ok) { std::fprintf(stderr, "%s: not a version %u frame ring\n", name, SHM_RING_VERSION); close(); }
+        return ok;
+    }
+
+    void close()
+    {
+        if (base) munmap(base, size);
+        if (owner) shm_unlink(ownedName);
+        base = nullptr; hdr = nullptr; size = 0; owner = false;
+    }
+
+    bool is_open() const { return hdr != nullptr; }
+    int width() const { return hdr->width; }
+    int height() const { return hdr->height; }
+    int slots() const { return hdr->slots; }
+
+    // Producer: frame n goes into slot n % slots, n counting from 1.
+    unsigned char* begin_write(uint64_t n)
+    {
+        ShmSlot& s = slot_of(n);
+        s.seq.store(2 * n - 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return frame_mut(n);
+    }
+    void end_write(uint64_t n)
+    {
+        ShmSlot& s = slot_of(n);
+        s.publishedNs = shm_ring_now_ns();
+        s.seq.store(2 * n, std::memory_order_release);
+        hdr->published.store(n, std::memory_order_release);
+    }
+
+    // Reader: the newest complete frame, and whether its slot still holds it.
+    // Check intact() before and after copying frame(n) out.
+    uint64_t latest() const { return hdr->published.load(std::memory_order_acquire); }
+    bool intact(uint64_t n) const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return n && slot_of(n).seq.load(std::memory_order_acquire) == 2 * n;
+    }
+    const unsigned char* frame(uint64_t n) const { return base + hdr->dataOffset + hdr->slotBytes * (n % hdr->slots); }
+    uint64_t published_ns(uint64_t n) const { return slot_of(n).publishedNs; }
+
+private:
+    ShmSlot& slot_of(uint64_t n) const { return hdr->slot[n % hdr->slots]; }
+    unsigned char* frame_mut(uint64_t n) { return base + hdr->dataOffset + hdr->slotBytes * (n % hdr->slots); }
+
+    unsigned char* base = nullptr;
+    ShmRingHeader* hdr = nullptr;
+    size_t size = 0;
+    bool owner = false;
+    char ownedName[256] = {};
+};
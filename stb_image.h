@@ -32,12 +32,12 @@
       PIC (Softimage PIC)
       PNM (PPM and PGM binary only)
 
-      Animated GIF still needs a proper API, but here's one way to do it:
-          http://gist.github.com/urraka/685d9a6340b26b830d49
+      Animated GIF: stbi_load_gif_from_memory decodes every frame at once;
+      stbi_gif_stream_* decodes one frame at a time in bounded memory.
 
       - decode from memory or through FILE (define STBI_NO_STDIO to remove code)
       - decode from arbitrary I/O callbacks
-      - SIMD acceleration on x86/x64 (SSE2) and ARM (NEON)
+      - SIMD acceleration on x86/x64 (SSE2, AVX2) and ARM (NEON)
 
    Full documentation under "DOCUMENTATION" below.
 
@@ -265,7 +265,10 @@ RECENT REVISION HISTORY:
 // code.)
 //
 // On x86, SSE2 will automatically be used when available based on a run-time
-// test; if not, the generic C versions are used as a fall-back. On ARM targets,
+// test; if not, the generic C versions are used as a fall-back. On GCC, Clang
+// and MSVC the JPEG IDCT, upsampling and color conversion kernels also have
+// AVX2 versions, compiled in regardless of -mavx2 and picked by a CPUID check
+// at run time; define STBI_NO_AVX2 to leave them out. On ARM targets,
 // the typical path is to have separate builds for NEON and non-NEON devices
 // (at least this is true for iOS and Android). Therefore, the NEON support is
 // toggled by a build flag: define STBI_NEON to get NEON loops.
@@ -431,6 +434,17 @@ STBIDEF stbi_uc *stbi_load_from_file  (FILE *f, int *x, int *y, int *channels_in
 
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp);
+
+// incremental animated GIF decoding. frames are always 4 channels and are
+// not affected by stbi_set_flip_vertically_on_load. the buffer passed to
+// open must stay alive until close. a frame returned by next stays valid
+// until the second call to next after it (or rewind/close), so one frame
+// can be consumed while the following one is decoded.
+typedef struct stbi_gif_stream stbi_gif_stream;
+STBIDEF stbi_gif_stream *stbi_gif_stream_open_memory(stbi_uc const *buffer, int len, int *x, int *y);
+STBIDEF int              stbi_gif_stream_next       (stbi_gif_stream *gs, stbi_uc **frame, int *delay_ms); // 1 = frame, 0 = end of stream, -1 = error
+STBIDEF void             stbi_gif_stream_rewind     (stbi_gif_stream *gs);
+STBIDEF void             stbi_gif_stream_close      (stbi_gif_stream *gs);
 #endif
 
 #ifdef STBI_WINDOWS_UTF8
@@ -524,6 +538,53 @@ STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpre
 STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+// PNG, JPEG, HDR, BMP and TGA write their rows straight into the order asked
+// for above; other formats are flipped afterwards. setting this flag instead
+// leaves every image in whichever order its loader produced most cheaply (BMP
+// and TGA are mostly stored bottom-up, the rest top-down), so a renderer can
+// flip with texture coordinates. stbi_last_load_bottom_up() tells you which
+// order the last image loaded on this thread came back in.
+STBIDEF void stbi_set_keep_row_order_on_load(int flag_true_if_should_keep);
+STBIDEF int  stbi_last_load_bottom_up(void);
+
+// per-call settings and results, for decoding on several threads at once
+// without touching the process-wide flags above. init copies in the current
+// settings; change what you like, then pass it to a _opt load. the load
+// fills in bottom_up, and failure_reason (NULL on success).
+//
+// failure_reason is copied out of stbi_failure_reason() after the load, so
+// it is only per-call where STBI_THREAD_LOCAL is available (any C11 or
+// C++11 compiler, or GCC). with STBI_NO_THREAD_LOCALS, or on a compiler
+// without thread-locals, concurrent _opt loads share one reason string and
+// may report each other's errors; the images and bottom_up stay per-call.
+// callers that need per-call errors should check STBI_THREAD_LOCAL in the
+// implementation file and refuse to build without it.
+typedef struct
+{
+   int flip_vertically;      // stbi_set_flip_vertically_on_load
+   int keep_row_order;       // stbi_set_keep_row_order_on_load
+   int unpremultiply;        // stbi_set_unpremultiply_on_load
+   int convert_iphone_png;   // stbi_convert_iphone_png_to_rgb
+
+   int bottom_up;            // out: rows of the result run bottom to top
+   const char *failure_reason; // out
+} stbi_load_options;
+
+STBIDEF void     stbi_load_options_init       (stbi_load_options *opt);
+STBIDEF stbi_uc *stbi_load_from_memory_opt    (stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels, stbi_load_options *opt);
+STBIDEF stbi_us *stbi_load_16_from_memory_opt (stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels, stbi_load_options *opt);
+#ifndef STBI_NO_LINEAR
+STBIDEF float   *stbi_loadf_from_memory_opt   (stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels, stbi_load_options *opt);
+#endif
+
+// multithreaded decoding: give stb_image a way to run 'count' independent
+// tasks and wait for all of them. decoders split suitable work across those
+// tasks; currently baseline JPEGs with restart intervals (DRI) decoded from
+// memory. set it once before decoding; NULL restores single-threaded decoding.
+typedef void stbi_parallel_task(void *task_user, int index);
+typedef void stbi_parallel_for (void *runner_user, int count, stbi_parallel_task *task, void *task_user);
+STBIDEF void stbi_set_parallel_for(stbi_parallel_for *run, void *runner_user);
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -750,7 +811,7 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#ifdef STBI_SSE2
 static int stbi__sse2_available(void)
 {
    int info3 = stbi__cpuid3();
@@ -761,7 +822,7 @@ static int stbi__sse2_available(void)
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#ifdef STBI_SSE2
 static int stbi__sse2_available(void)
 {
    // If we're even attempting to compile this on GCC/Clang, that means
@@ -774,6 +835,36 @@ static int stbi__sse2_available(void)
 #endif
 #endif
 
+// AVX2 JPEG kernels are compiled with a per-function target attribute and
+// only called after a run-time check, so they need no -mavx2.
+#if defined(STBI_SSE2) && !defined(STBI_NO_AVX2) && !defined(STBI_NO_JPEG) && \
+    ((defined(_MSC_VER) && _MSC_VER >= 1700) || defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define STBI_AVX2
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define STBI__AVX2_TARGET
+static int stbi__avx2_available(void)
+{
+   int info[4];
+   __cpuid(info, 0);
+   if (info[0] < 7) return 0;
+   __cpuid(info, 1);
+   if (((info[2] >> 27) & 1) == 0 || ((info[2] >> 28) & 1) == 0) return 0; // OSXSAVE, AVX
+   if ((_xgetbv(0) & 6) != 6) return 0; // OS saves ymm state
+   __cpuidex(info, 7, 0);
+   return (info[1] >> 5) & 1;
+}
+#else
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+static int stbi__avx2_available(void)
+{
+   __builtin_cpu_init();
+   return __builtin_cpu_supports("avx2") != 0;
+}
+#endif
+#endif
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -817,6 +908,8 @@ typedef struct
 
    stbi_uc *img_buffer, *img_buffer_end;
    stbi_uc *img_buffer_original, *img_buffer_original_end;
+
+   stbi_load_options *opt; // per-call settings and results; NULL uses the global ones
 } stbi__context;
 
 
@@ -828,6 +921,7 @@ static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
    s->io.read = NULL;
    s->read_from_callbacks = 0;
    s->callback_already_read = 0;
+   s->opt = NULL;
    s->img_buffer = s->img_buffer_original = (stbi_uc *) buffer;
    s->img_buffer_end = s->img_buffer_original_end = (stbi_uc *) buffer+len;
 }
@@ -840,6 +934,7 @@ static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *
    s->buflen = sizeof(s->buffer_start);
    s->read_from_callbacks = 1;
    s->callback_already_read = 0;
+   s->opt = NULL;
    s->img_buffer = s->img_buffer_original = s->buffer_start;
    stbi__refill_buffer(s);
    s->img_buffer_original_end = s->img_buffer_end;
@@ -903,6 +998,7 @@ typedef struct
    int bits_per_channel;
    int num_channels;
    int channel_order;
+   int bottom_up; // rows are stored bottom to top
 } stbi__result_info;
 
 #ifndef STBI_NO_JPEG
@@ -1134,6 +1230,49 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
+static int stbi__keep_row_order_on_load = 0;
+
+static
+#ifdef STBI_THREAD_LOCAL
+STBI_THREAD_LOCAL
+#endif
+int stbi__last_bottom_up;
+
+STBIDEF void stbi_set_keep_row_order_on_load(int flag_true_if_should_keep)
+{
+   stbi__keep_row_order_on_load = flag_true_if_should_keep;
+}
+
+STBIDEF int stbi_last_load_bottom_up(void)
+{
+   return stbi__last_bottom_up;
+}
+
+#define stbi__flip_on_load(s)       ((s)->opt ? (s)->opt->flip_vertically : stbi__vertically_flip_on_load)
+#define stbi__keep_row_order(s)     ((s)->opt ? (s)->opt->keep_row_order  : stbi__keep_row_order_on_load)
+
+static stbi_parallel_for *stbi__parallel_for_func;
+static void *stbi__parallel_for_user;
+
+STBIDEF void stbi_set_parallel_for(stbi_parallel_for *run, void *runner_user)
+{
+   stbi__parallel_for_func = run;
+   stbi__parallel_for_user = runner_user;
+}
+
+#ifndef STBI_NO_JPEG
+// runs task(user, 0..count-1), on the registered runner if there is one
+static void stbi__parallel_for_run(int count, stbi_parallel_task *task, void *user)
+{
+   int i;
+   if (stbi__parallel_for_func && count > 1)
+      stbi__parallel_for_func(stbi__parallel_for_user, count, task, user);
+   else
+      for (i=0; i < count; ++i)
+         task(user, i);
+}
+#endif
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1187,20 +1326,35 @@ static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int re
    return stbi__errpuc("unknown image type", "Image not of any known type, or corrupt");
 }
 
+// converts in place: byte i is written only after sample i (bytes 2i, 2i+1)
+// has been read, then the block is shrunk
 static stbi_uc *stbi__convert_16_to_8(stbi__uint16 *orig, int w, int h, int channels)
 {
-   int i;
+   int i = 0;
    int img_len = w * h * channels;
-   stbi_uc *reduced;
+   stbi_uc *reduced = (stbi_uc *) orig;
+   void *shrunk;
 
-   reduced = (stbi_uc *) stbi__malloc(img_len);
-   if (reduced == NULL) return stbi__errpuc("outofmem", "Out of memory");
-
-   for (i = 0; i < img_len; ++i)
+#ifdef STBI_SSE2
+   if (stbi__sse2_available()) {
+      for (; i + 16 <= img_len; i += 16) {
+         __m128i a = _mm_loadu_si128((__m128i *) (orig + i));
+         __m128i b = _mm_loadu_si128((__m128i *) (orig + i + 8));
+         _mm_storeu_si128((__m128i *) (reduced + i), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+      }
+   }
+#elif defined(STBI_NEON)
+   for (; i + 16 <= img_len; i += 16) {
+      uint16x8_t a = vld1q_u16(orig + i);
+      uint16x8_t b = vld1q_u16(orig + i + 8);
+      vst1q_u8(reduced + i, vcombine_u8(vshrn_n_u16(a, 8), vshrn_n_u16(b, 8)));
+   }
+#endif
+   for (; i < img_len; ++i)
       reduced[i] = (stbi_uc)((orig[i] >> 8) & 0xFF); // top half of each byte is sufficient approx of 16->8 bit scaling
 
-   STBI_FREE(orig);
-   return reduced;
+   shrunk = STBI_REALLOC_SIZED(reduced, (size_t) img_len * 2, img_len > 0 ? img_len : 1);
+   return shrunk ? (stbi_uc *) shrunk : reduced;
 }
 
 static stbi__uint16 *stbi__convert_8_to_16(stbi_uc *orig, int w, int h, int channels)
@@ -1243,6 +1397,18 @@ static void stbi__vertical_flip(void *image, int w, int h, int bytes_per_pixel)
    }
 }
 
+// loaders that can place rows for free produce the requested order; anything
+// else gets flipped here, unless the caller is happy with either
+static void stbi__orient_rows(stbi__context *s, void *image, int w, int h, int bytes_per_pixel, int bottom_up)
+{
+   if (bottom_up != (stbi__flip_on_load(s) != 0) && !stbi__keep_row_order(s)) {
+      stbi__vertical_flip(image, w, h, bytes_per_pixel);
+      bottom_up = !bottom_up;
+   }
+   if (s->opt) s->opt->bottom_up = bottom_up;
+   else        stbi__last_bottom_up = bottom_up;
+}
+
 #ifndef STBI_NO_GIF
 static void stbi__vertical_flip_slices(void *image, int w, int h, int z, int bytes_per_pixel)
 {
@@ -1275,10 +1441,7 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
 
    // @TODO: move stbi__convert_format to here
 
-   if (stbi__vertically_flip_on_load) {
-      int channels = req_comp ? req_comp : *comp;
-      stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi_uc));
-   }
+   stbi__orient_rows(s, result, *x, *y, (req_comp ? req_comp : *comp) * sizeof(stbi_uc), ri.bottom_up);
 
    return (unsigned char *) result;
 }
@@ -1302,21 +1465,16 @@ static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x,
    // @TODO: move stbi__convert_format16 to here
    // @TODO: special case RGB-to-Y (and RGBA-to-YA) for 8-bit-to-16-bit case to keep more precision
 
-   if (stbi__vertically_flip_on_load) {
-      int channels = req_comp ? req_comp : *comp;
-      stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi__uint16));
-   }
+   stbi__orient_rows(s, result, *x, *y, (req_comp ? req_comp : *comp) * sizeof(stbi__uint16), ri.bottom_up);
 
    return (stbi__uint16 *) result;
 }
 
 #if !defined(STBI_NO_HDR) && !defined(STBI_NO_LINEAR)
-static void stbi__float_postprocess(float *result, int *x, int *y, int *comp, int req_comp)
+static void stbi__float_postprocess(stbi__context *s, float *result, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
 {
-   if (stbi__vertically_flip_on_load && result != NULL) {
-      int channels = req_comp ? req_comp : *comp;
-      stbi__vertical_flip(result, *x, *y, channels * sizeof(float));
-   }
+   if (result != NULL)
+      stbi__orient_rows(s, result, *x, *y, (req_comp ? req_comp : *comp) * sizeof(float), ri->bottom_up);
 }
 #endif
 
@@ -1440,6 +1598,28 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *u
    return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
 }
 
+STBIDEF stbi_uc *stbi_load_from_memory_opt(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, stbi_load_options *opt)
+{
+   stbi_uc *result;
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   s.opt = opt;
+   result = stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+   opt->failure_reason = result ? NULL : stbi_failure_reason();
+   return result;
+}
+
+STBIDEF stbi_us *stbi_load_16_from_memory_opt(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, stbi_load_options *opt)
+{
+   stbi_us *result;
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   s.opt = opt;
+   result = stbi__load_and_postprocess_16bit(&s,x,y,comp,req_comp);
+   opt->failure_reason = result ? NULL : stbi_failure_reason();
+   return result;
+}
+
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp)
 {
@@ -1463,9 +1643,11 @@ static float *stbi__loadf_main(stbi__context *s, int *x, int *y, int *comp, int
    #ifndef STBI_NO_HDR
    if (stbi__hdr_test(s)) {
       stbi__result_info ri;
-      float *hdr_data = stbi__hdr_load(s,x,y,comp,req_comp, &ri);
+      float *hdr_data;
+      memset(&ri, 0, sizeof(ri));
+      hdr_data = stbi__hdr_load(s,x,y,comp,req_comp, &ri);
       if (hdr_data)
-         stbi__float_postprocess(hdr_data,x,y,comp,req_comp);
+         stbi__float_postprocess(s,hdr_data,x,y,comp,req_comp, &ri);
       return hdr_data;
    }
    #endif
@@ -1482,6 +1664,17 @@ STBIDEF float *stbi_loadf_from_memory(stbi_uc const *buffer, int len, int *x, in
    return stbi__loadf_main(&s,x,y,comp,req_comp);
 }
 
+STBIDEF float *stbi_loadf_from_memory_opt(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, stbi_load_options *opt)
+{
+   float *result;
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   s.opt = opt;
+   result = stbi__loadf_main(&s,x,y,comp,req_comp);
+   opt->failure_reason = result ? NULL : stbi_failure_reason();
+   return result;
+}
+
 STBIDEF float *stbi_loadf_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp)
 {
    stbi__context s;
@@ -1752,6 +1945,91 @@ static stbi_uc stbi__compute_y(int r, int g, int b)
 #if defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
 // nothing
 #else
+// expands n pixels of img_n (1..3) components to 4 in place; data holds 4*n
+// bytes. pixels are written back to front, and every source pixel is read
+// before anything is stored over it.
+static void stbi__expand_to_rgba(stbi_uc *data, int img_n, stbi__uint32 n)
+{
+   stbi__uint32 i, m = 0, step = 0;
+#ifdef STBI_SSE2
+   if (stbi__sse2_available()) step = img_n == 1 ? 16 : img_n == 2 ? 8 : 4;
+#elif defined(STBI_NEON)
+   step = 16;
+#endif
+   if (step) m = n - n % step;
+
+   // the tail past the last whole vector first
+   for (i = n; i > m; ) {
+      stbi_uc *src = data + (--i) * img_n, *dest = data + i * 4;
+      stbi_uc r = src[0], g = img_n == 3 ? src[1] : r, b = img_n == 3 ? src[2] : r;
+      stbi_uc a = img_n == 2 ? src[1] : 255;
+      dest[0] = r; dest[1] = g; dest[2] = b; dest[3] = a;
+   }
+
+#ifdef STBI_SSE2
+   if (step) {
+      __m128i ff = _mm_set1_epi8((char) 255);
+      if (img_n == 1) {
+         for (i = m; i > 0; ) {
+            __m128i g, gg0, gg1, ga0, ga1;
+            i -= 16;
+            g = _mm_loadu_si128((__m128i *) (data + i));
+            gg0 = _mm_unpacklo_epi8(g, g);  gg1 = _mm_unpackhi_epi8(g, g);
+            ga0 = _mm_unpacklo_epi8(g, ff); ga1 = _mm_unpackhi_epi8(g, ff);
+            _mm_storeu_si128((__m128i *) (data + i*4 +  0), _mm_unpacklo_epi16(gg0, ga0));
+            _mm_storeu_si128((__m128i *) (data + i*4 + 16), _mm_unpackhi_epi16(gg0, ga0));
+            _mm_storeu_si128((__m128i *) (data + i*4 + 32), _mm_unpacklo_epi16(gg1, ga1));
+            _mm_storeu_si128((__m128i *) (data + i*4 + 48), _mm_unpackhi_epi16(gg1, ga1));
+         }
+      } else if (img_n == 2) {
+         __m128i lo = _mm_set1_epi16(0xff);
+         for (i = m; i > 0; ) {
+            __m128i ga, g, gg;
+            i -= 8;
+            ga = _mm_loadu_si128((__m128i *) (data + i*2));
+            g  = _mm_and_si128(ga, lo);
+            gg = _mm_or_si128(g, _mm_slli_epi16(g, 8));
+            _mm_storeu_si128((__m128i *) (data + i*4 +  0), _mm_unpacklo_epi16(gg, ga));
+            _mm_storeu_si128((__m128i *) (data + i*4 + 16), _mm_unpackhi_epi16(gg, ga));
+         }
+      } else {
+         // 4 pixels from 16 bytes: shift pixel k up by k bytes into lane k,
+         // keep the lane, force alpha. the load runs 4 bytes past the 12
+         // source bytes, which is still inside the 4*n buffer.
+         __m128i lane0 = _mm_setr_epi32(-1, 0, 0, 0), lane1 = _mm_setr_epi32(0, -1, 0, 0);
+         __m128i lane2 = _mm_setr_epi32(0, 0, -1, 0), lane3 = _mm_setr_epi32(0, 0, 0, -1);
+         __m128i alpha = _mm_set1_epi32((int) 0xff000000u);
+         for (i = m; i > 0; ) {
+            __m128i v, p01, p23;
+            i -= 4;
+            v = _mm_loadu_si128((__m128i *) (data + i*3));
+            p01 = _mm_or_si128(_mm_and_si128(v, lane0), _mm_and_si128(_mm_slli_si128(v, 1), lane1));
+            p23 = _mm_or_si128(_mm_and_si128(_mm_slli_si128(v, 2), lane2), _mm_and_si128(_mm_slli_si128(v, 3), lane3));
+            _mm_storeu_si128((__m128i *) (data + i*4), _mm_or_si128(_mm_or_si128(p01, p23), alpha));
+         }
+      }
+   }
+#elif defined(STBI_NEON)
+   for (i = m; i > 0; ) {
+      uint8x16x4_t o;
+      i -= 16;
+      if (img_n == 1) {
+         o.val[0] = o.val[1] = o.val[2] = vld1q_u8(data + i);
+         o.val[3] = vdupq_n_u8(255);
+      } else if (img_n == 2) {
+         uint8x16x2_t ga = vld2q_u8(data + i*2);
+         o.val[0] = o.val[1] = o.val[2] = ga.val[0];
+         o.val[3] = ga.val[1];
+      } else {
+         uint8x16x3_t rgb = vld3q_u8(data + i*3);
+         o.val[0] = rgb.val[0]; o.val[1] = rgb.val[1]; o.val[2] = rgb.val[2];
+         o.val[3] = vdupq_n_u8(255);
+      }
+      vst4q_u8(data + i*4, o);
+   }
+#endif
+}
+
 static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y)
 {
    int i,j;
@@ -1760,6 +2038,22 @@ static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int r
    if (req_comp == img_n) return data;
    STBI_ASSERT(req_comp >= 1 && req_comp <= 4);
 
+   if (req_comp == 4) {
+      // the common case is expanded in place; growing the block usually
+      // extends or remaps it rather than copying
+      if (!stbi__mad3sizes_valid(4, x, y, 0)) {
+         STBI_FREE(data);
+         return stbi__errpuc("too large", "Image too large to decode");
+      }
+      good = (unsigned char *) STBI_REALLOC_SIZED(data, (size_t) img_n * x * y, (size_t) 4 * x * y);
+      if (good == NULL) {
+         STBI_FREE(data);
+         return stbi__errpuc("outofmem", "Out of memory");
+      }
+      stbi__expand_to_rgba(good, img_n, x * y);
+      return good;
+   }
+
    good = (unsigned char *) stbi__malloc_mad3(req_comp, x, y, 0);
    if (good == NULL) {
       STBI_FREE(data);
@@ -1809,6 +2103,93 @@ static stbi__uint16 stbi__compute_y_16(int r, int g, int b)
 #if defined(STBI_NO_PNG) && defined(STBI_NO_PSD)
 // nothing
 #else
+// 16-bit version of stbi__expand_to_rgba: n pixels of img_n (1..3)
+// components to 4 in place, back to front; data holds 4*n values.
+static void stbi__expand_to_rgba16(stbi__uint16 *data, int img_n, stbi__uint32 n)
+{
+   stbi__uint32 i, m = 0, step = 0;
+#ifdef STBI_SSE2
+   if (stbi__sse2_available()) step = img_n == 1 ? 8 : 4;
+#elif defined(STBI_NEON)
+   step = 8;
+#endif
+   if (step) m = n - n % step;
+
+   // the tail past the last whole vector first
+   for (i = n; i > m; ) {
+      stbi__uint16 *src = data + (--i) * img_n, *dest = data + i * 4;
+      stbi__uint16 r = src[0], g = img_n == 3 ? src[1] : r, b = img_n == 3 ? src[2] : r;
+      stbi__uint16 a = img_n == 2 ? src[1] : 0xffff;
+      dest[0] = r; dest[1] = g; dest[2] = b; dest[3] = a;
+   }
+
+#ifdef STBI_SSE2
+   if (step) {
+      __m128i ff = _mm_set1_epi16(-1);
+      if (img_n == 1) {
+         for (i = m; i > 0; ) {
+            __m128i g, gg0, gg1, ga0, ga1;
+            i -= 8;
+            g = _mm_loadu_si128((__m128i *) (data + i));
+            gg0 = _mm_unpacklo_epi16(g, g);  gg1 = _mm_unpackhi_epi16(g, g);
+            ga0 = _mm_unpacklo_epi16(g, ff); ga1 = _mm_unpackhi_epi16(g, ff);
+            _mm_storeu_si128((__m128i *) (data + i*4 +  0), _mm_unpacklo_epi32(gg0, ga0));
+            _mm_storeu_si128((__m128i *) (data + i*4 +  8), _mm_unpackhi_epi32(gg0, ga0));
+            _mm_storeu_si128((__m128i *) (data + i*4 + 16), _mm_unpacklo_epi32(gg1, ga1));
+            _mm_storeu_si128((__m128i *) (data + i*4 + 24), _mm_unpackhi_epi32(gg1, ga1));
+         }
+      } else if (img_n == 2) {
+         __m128i lo = _mm_set1_epi32(0xffff);
+         for (i = m; i > 0; ) {
+            __m128i ga, g, gg;
+            i -= 4;
+            ga = _mm_loadu_si128((__m128i *) (data + i*2));
+            g  = _mm_and_si128(ga, lo);
+            gg = _mm_or_si128(g, _mm_slli_epi32(g, 16));
+            _mm_storeu_si128((__m128i *) (data + i*4 + 0), _mm_unpacklo_epi32(gg, ga));
+            _mm_storeu_si128((__m128i *) (data + i*4 + 8), _mm_unpackhi_epi32(gg, ga));
+         }
+      } else {
+         // 2 pixels per load: pixel 1 moves up one value into the high
+         // half, alpha is forced. each load runs 2 values past the 6 it
+         // uses, which is still inside the 4*n buffer and below anything
+         // already stored.
+         __m128i half0 = _mm_setr_epi16(-1, -1, -1, 0, 0, 0, 0, 0);
+         __m128i half1 = _mm_setr_epi16(0, 0, 0, 0, -1, -1, -1, 0);
+         __m128i alpha = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+         for (i = m; i > 0; ) {
+            __m128i v0, v1, p0, p1;
+            i -= 4;
+            v0 = _mm_loadu_si128((__m128i *) (data + i*3));
+            v1 = _mm_loadu_si128((__m128i *) (data + i*3 + 6));
+            p0 = _mm_or_si128(_mm_and_si128(v0, half0), _mm_and_si128(_mm_slli_si128(v0, 2), half1));
+            p1 = _mm_or_si128(_mm_and_si128(v1, half0), _mm_and_si128(_mm_slli_si128(v1, 2), half1));
+            _mm_storeu_si128((__m128i *) (data + i*4 + 0), _mm_or_si128(p0, alpha));
+            _mm_storeu_si128((__m128i *) (data + i*4 + 8), _mm_or_si128(p1, alpha));
+         }
+      }
+   }
+#elif defined(STBI_NEON)
+   for (i = m; i > 0; ) {
+      uint16x8x4_t o;
+      i -= 8;
+      if (img_n == 1) {
+         o.val[0] = o.val[1] = o.val[2] = vld1q_u16(data + i);
+         o.val[3] = vdupq_n_u16(0xffff);
+      } else if (img_n == 2) {
+         uint16x8x2_t ga = vld2q_u16(data + i*2);
+         o.val[0] = o.val[1] = o.val[2] = ga.val[0];
+         o.val[3] = ga.val[1];
+      } else {
+         uint16x8x3_t rgb = vld3q_u16(data + i*3);
+         o.val[0] = rgb.val[0]; o.val[1] = rgb.val[1]; o.val[2] = rgb.val[2];
+         o.val[3] = vdupq_n_u16(0xffff);
+      }
+      vst4q_u16(data + i*4, o);
+   }
+#endif
+}
+
 static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int req_comp, unsigned int x, unsigned int y)
 {
    int i,j;
@@ -1817,6 +2198,21 @@ static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int r
    if (req_comp == img_n) return data;
    STBI_ASSERT(req_comp >= 1 && req_comp <= 4);
 
+   if (req_comp == 4) {
+      // in place, as the 8-bit case
+      if (!stbi__mad3sizes_valid(8, x, y, 0)) {
+         STBI_FREE(data);
+         return (stbi__uint16 *) stbi__errpuc("too large", "Image too large to decode");
+      }
+      good = (stbi__uint16 *) STBI_REALLOC_SIZED(data, (size_t) img_n * x * y * 2, (size_t) 8 * x * y);
+      if (good == NULL) {
+         STBI_FREE(data);
+         return (stbi__uint16 *) stbi__errpuc("outofmem", "Out of memory");
+      }
+      stbi__expand_to_rgba16(good, img_n, x * y);
+      return good;
+   }
+
    good = (stbi__uint16 *) stbi__malloc(req_comp * x * y * 2);
    if (good == NULL) {
       STBI_FREE(data);
@@ -1990,12 +2386,14 @@ typedef struct
    int            jfif;
    int            app14_color_transform; // Adobe APP14 tag
    int            rgb;
+   int            bottom_up; // write output rows bottom to top
 
    int scan_n, order[4];
    int restart_interval, todo;
 
 // kernels
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
+   void (*idct_block_x2_kernel)(stbi_uc *out, int out_stride, short data0[64], short data1[64]); // may be NULL
    void (*YCbCr_to_RGB_kernel)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
    stbi_uc *(*resample_row_hv_2_kernel)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
 } stbi__jpeg;
@@ -2704,6 +3102,191 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 
 #endif // STBI_SSE2
 
+#ifdef STBI_AVX2
+// avx2 integer IDCT of two horizontally adjacent blocks at once: block 0 in
+// the low 128-bit lane, block 1 in the high lane. every op used is either
+// lane-local or elementwise, so each lane runs exactly the sse2 sequence
+// above and the output is bit-identical to it.
+STBI__AVX2_TARGET
+static void stbi__idct_avx2_x2(stbi_uc *out, int out_stride, short data0[64], short data1[64])
+{
+   __m256i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m256i tmp;
+
+   #define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y))
+
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##lo = _mm256_unpacklo_epi16((x),(y)); \
+      __m256i c0##hi = _mm256_unpackhi_epi16((x),(y)); \
+      __m256i out0##_l = _mm256_madd_epi16(c0##lo, c0); \
+      __m256i out0##_h = _mm256_madd_epi16(c0##hi, c0); \
+      __m256i out1##_l = _mm256_madd_epi16(c0##lo, c1); \
+      __m256i out1##_h = _mm256_madd_epi16(c0##hi, c1)
+
+   #define dct_widen(out, in) \
+      __m256i out##_l = _mm256_srai_epi32(_mm256_unpacklo_epi16(_mm256_setzero_si256(), (in)), 4); \
+      __m256i out##_h = _mm256_srai_epi32(_mm256_unpackhi_epi16(_mm256_setzero_si256(), (in)), 4)
+
+   #define dct_wadd(out, a, b) \
+      __m256i out##_l = _mm256_add_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_add_epi32(a##_h, b##_h)
+
+   #define dct_wsub(out, a, b) \
+      __m256i out##_l = _mm256_sub_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_sub_epi32(a##_h, b##_h)
+
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased_l = _mm256_add_epi32(a##_l, bias); \
+         __m256i abiased_h = _mm256_add_epi32(a##_h, bias); \
+         dct_wadd(sum, abiased, b); \
+         dct_wsub(dif, abiased, b); \
+         out0 = _mm256_packs_epi32(_mm256_srai_epi32(sum_l, s), _mm256_srai_epi32(sum_h, s)); \
+         out1 = _mm256_packs_epi32(_mm256_srai_epi32(dif_l, s), _mm256_srai_epi32(dif_h, s)); \
+      }
+
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi8(a, b); \
+      b = _mm256_unpackhi_epi8(tmp, b)
+
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi16(a, b); \
+      b = _mm256_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m256i sum04 = _mm256_add_epi16(row0, row4); \
+         __m256i dif04 = _mm256_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         dct_wadd(x0, t0e, t3e); \
+         dct_wsub(x3, t0e, t3e); \
+         dct_wadd(x1, t1e, t2e); \
+         dct_wsub(x2, t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m256i sum17 = _mm256_add_epi16(row1, row7); \
+         __m256i sum35 = _mm256_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         dct_wadd(x4, y0o, y4o); \
+         dct_wadd(x5, y1o, y5o); \
+         dct_wadd(x6, y2o, y5o); \
+         dct_wadd(x7, y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   // row r of block 0 in the low lane, row r of block 1 in the high lane
+   #define dct_load2(r) \
+      _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_load_si128((const __m128i *) (data0 + (r)*8))), \
+                              _mm_load_si128((const __m128i *) (data1 + (r)*8)), 1)
+
+   // same store sequence as the sse2 kernel, for one lane's worth of output
+   #define dct_store_block(o, p0,p1,p2,p3) \
+      { \
+         stbi_uc *d = (o); \
+         _mm_storel_epi64((__m128i *) d, p0); d += out_stride; \
+         _mm_storel_epi64((__m128i *) d, _mm_shuffle_epi32(p0, 0x4e)); d += out_stride; \
+         _mm_storel_epi64((__m128i *) d, p2); d += out_stride; \
+         _mm_storel_epi64((__m128i *) d, _mm_shuffle_epi32(p2, 0x4e)); d += out_stride; \
+         _mm_storel_epi64((__m128i *) d, p1); d += out_stride; \
+         _mm_storel_epi64((__m128i *) d, _mm_shuffle_epi32(p1, 0x4e)); d += out_stride; \
+         _mm_storel_epi64((__m128i *) d, p3); d += out_stride; \
+         _mm_storel_epi64((__m128i *) d, _mm_shuffle_epi32(p3, 0x4e)); \
+      }
+
+   __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+   __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+   __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+   __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+   __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+   __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   // load
+   row0 = dct_load2(0);
+   row1 = dct_load2(1);
+   row2 = dct_load2(2);
+   row3 = dct_load2(3);
+   row4 = dct_load2(4);
+   row5 = dct_load2(5);
+   row6 = dct_load2(6);
+   row7 = dct_load2(7);
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      // 16bit 8x8 transpose, within each lane
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      // pack
+      __m256i p0 = _mm256_packus_epi16(row0, row1);
+      __m256i p1 = _mm256_packus_epi16(row2, row3);
+      __m256i p2 = _mm256_packus_epi16(row4, row5);
+      __m256i p3 = _mm256_packus_epi16(row6, row7);
+
+      // 8bit 8x8 transpose, within each lane
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      dct_interleave8(p0, p1);
+      dct_interleave8(p2, p3);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      // store: low lanes are block 0, high lanes are block 1
+      dct_store_block(out,     _mm256_castsi256_si128(p0),      _mm256_castsi256_si128(p1),
+                               _mm256_castsi256_si128(p2),      _mm256_castsi256_si128(p3));
+      dct_store_block(out + 8, _mm256_extracti128_si256(p0, 1), _mm256_extracti128_si256(p1, 1),
+                               _mm256_extracti128_si256(p2, 1), _mm256_extracti128_si256(p3, 1));
+   }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+#undef dct_load2
+#undef dct_store_block
+}
+
+#endif // STBI_AVX2
+
 #ifdef STBI_NEON
 
 // NEON integer IDCT. should produce bit-identical
@@ -2946,13 +3529,169 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
+// idct block i of a row of n horizontally adjacent blocks that was just
+// decoded into data[pending]. with the two-block kernel, even blocks are held
+// back until their right neighbour arrives; returns the new pending flag.
+static int stbi__jpeg_idct_step(stbi__jpeg *z, stbi_uc *out, int out_stride, int i, int n, short data[2][64], int pending)
+{
+   if (!z->idct_block_x2_kernel) {
+      z->idct_block_kernel(out+i*8, out_stride, data[0]);
+   } else if (pending) {
+      z->idct_block_x2_kernel(out+(i-1)*8, out_stride, data[0], data[1]);
+   } else if (i+1 < n) {
+      return 1;
+   } else {
+      z->idct_block_kernel(out+i*8, out_stride, data[0]);
+   }
+   return 0;
+}
+
+// decode 'count' baseline MCUs starting at MCU index 'first'; the entropy
+// decoder must already be positioned at the first of them (i.e. at the
+// start of a restart interval)
+static int stbi__jpeg_decode_mcus(stbi__jpeg *z, int first, int count)
+{
+   STBI_SIMD_ALIGN(short, data[2][64]);
+   int m, last = first + count;
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      int w = (z->img_comp[n].x+7) >> 3;
+      int ha = z->img_comp[n].ha;
+      int pending = 0;
+      for (m=first; m < last; ++m) {
+         int i = m % w, j = m / w;
+         stbi_uc *out = z->img_comp[n].data+z->img_comp[n].w2*j*8;
+         if (!stbi__jpeg_decode_block(z, data[pending], z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+         // the interval may end mid-row; flush a held-back block there
+         pending = stbi__jpeg_idct_step(z, out, z->img_comp[n].w2, i, m+1 < last ? w : i+1, data, pending);
+      }
+   } else {
+      int k,x,y;
+      for (m=first; m < last; ++m) {
+         int i = m % z->img_mcu_x, j = m / z->img_mcu_x;
+         for (k=0; k < z->scan_n; ++k) {
+            int n = z->order[k];
+            for (y=0; y < z->img_comp[n].v; ++y) {
+               int y2 = (j*z->img_comp[n].v + y)*8;
+               stbi_uc *out = z->img_comp[n].data+z->img_comp[n].w2*y2+i*z->img_comp[n].h*8;
+               int pending = 0;
+               for (x=0; x < z->img_comp[n].h; ++x) {
+                  int ha = z->img_comp[n].ha;
+                  if (!stbi__jpeg_decode_block(z, data[pending], z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                  pending = stbi__jpeg_idct_step(z, out, z->img_comp[n].w2, x, z->img_comp[n].h, data, pending);
+               }
+            }
+         }
+      }
+   }
+   return 1;
+}
+
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi_uc *base;
+   int *start;        // byte offset of each interval, plus the end of the scan
+   int intervals, per_task, total_mcus;
+   int *ok;
+} stbi__jpeg_restart_job;
+
+static void stbi__jpeg_restart_task(void *user, int t)
+{
+   stbi__jpeg_restart_job *job = (stbi__jpeg_restart_job *) user;
+   int k, k0 = t * job->per_task, k1 = k0 + job->per_task;
+   int ri = job->z->restart_interval;
+   stbi__context ctx;
+   // private copy of the decoder state; tables are read-only, output blocks
+   // of different intervals never overlap
+   stbi__jpeg *j = (stbi__jpeg *) stbi__malloc(sizeof(stbi__jpeg));
+   job->ok[t] = 0;
+   if (!j) return;
+   memcpy(j, job->z, sizeof(*j));
+   j->s = &ctx;
+   if (k1 > job->intervals) k1 = job->intervals;
+   for (k=k0; k < k1; ++k) {
+      int first = k * ri, count = job->total_mcus - first;
+      if (count > ri) count = ri;
+      stbi__start_mem(&ctx, job->base + job->start[k], job->start[k+1] - job->start[k]);
+      stbi__jpeg_reset(j);
+      if (!stbi__jpeg_decode_mcus(j, first, count)) { STBI_FREE(j); return; }
+   }
+   STBI_FREE(j);
+   job->ok[t] = 1;
+}
+
+// restart markers make intervals independent: find them all up front and
+// decode the intervals as parallel tasks. returns -1 if this scan is not
+// eligible (the caller then decodes serially), else 0/1 for failure/success.
+static int stbi__jpeg_decode_restarts_parallel(stbi__jpeg *z)
+{
+   stbi__context *s = z->s;
+   stbi__jpeg_restart_job job;
+   stbi_uc *p, *end;
+   int n, total, expected, tasks, found = 0, result = 1;
+
+   if (!stbi__parallel_for_func || z->progressive || !z->restart_interval || s->read_from_callbacks)
+      return -1;
+   if (z->scan_n == 1) {
+      n = z->order[0];
+      total = ((z->img_comp[n].x+7) >> 3) * ((z->img_comp[n].y+7) >> 3);
+   } else {
+      total = z->img_mcu_x * z->img_mcu_y;
+   }
+   expected = (total + z->restart_interval - 1) / z->restart_interval;
+   if (expected < 2) return -1;
+
+   job.start = (int *) stbi__malloc_mad2(expected + 1, sizeof(int), 0);
+   if (!job.start) return -1;
+
+   // scan for RSTn up to the first other marker, which ends the scan
+   p = s->img_buffer; end = s->img_buffer_end;
+   job.start[found++] = 0;
+   while (p < end) {
+      if (*p++ != 0xff) continue;
+      while (p < end && *p == 0xff) ++p; // fill bytes
+      if (p == end) break;
+      if (*p == 0x00) { ++p; continue; } // stuffed zero
+      if (!STBI__RESTART(*p)) { --p; break; } // back up onto the 0xff
+      ++p;
+      if (found == expected) { found = -1; break; }
+      job.start[found++] = (int) (p - s->img_buffer);
+   }
+   if (found != expected) { STBI_FREE(job.start); return -1; }
+   job.start[found] = (int) (p - s->img_buffer);
+
+   tasks = expected < 64 ? expected : 64;
+   job.z = z;
+   job.base = s->img_buffer;
+   job.intervals = expected;
+   job.per_task = (expected + tasks - 1) / tasks;
+   job.total_mcus = total;
+   tasks = (expected + job.per_task - 1) / job.per_task;
+   job.ok = (int *) stbi__malloc_mad2(tasks, sizeof(int), 0);
+   if (!job.ok) { STBI_FREE(job.start); return -1; }
+
+   stbi__parallel_for_run(tasks, stbi__jpeg_restart_task, &job);
+   for (n=0; n < tasks; ++n)
+      if (!job.ok[n]) result = 0;
+
+   // leave the stream at the marker that ended the scan, as the serial path would
+   s->img_buffer += job.start[found];
+   z->marker = STBI__MARKER_none;
+   STBI_FREE(job.ok);
+   STBI_FREE(job.start);
+   return result ? 1 : stbi__err("bad restart interval", "Corrupt JPEG");
+}
+
 static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 {
    stbi__jpeg_reset(z);
    if (!z->progressive) {
+      int r = stbi__jpeg_decode_restarts_parallel(z);
+      if (r >= 0) return r;
       if (z->scan_n == 1) {
          int i,j;
-         STBI_SIMD_ALIGN(short, data[64]);
+         STBI_SIMD_ALIGN(short, data[2][64]);
          int n = z->order[0];
          // non-interleaved data, we just need to process one block at a time,
          // in trivial scanline order
@@ -2961,16 +3700,21 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
          int w = (z->img_comp[n].x+7) >> 3;
          int h = (z->img_comp[n].y+7) >> 3;
          for (j=0; j < h; ++j) {
+            stbi_uc *out = z->img_comp[n].data+z->img_comp[n].w2*j*8;
+            int pending = 0;
             for (i=0; i < w; ++i) {
                int ha = z->img_comp[n].ha;
-               if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               if (!stbi__jpeg_decode_block(z, data[pending], z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+               pending = stbi__jpeg_idct_step(z, out, z->img_comp[n].w2, i, w, data, pending);
                // every data block is an MCU, so countdown the restart interval
                if (--z->todo <= 0) {
                   if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
                   // if it's NOT a restart, then just bail, so we get corrupt data
                   // rather than no data
-                  if (!STBI__RESTART(z->marker)) return 1;
+                  if (!STBI__RESTART(z->marker)) {
+                     if (pending) z->idct_block_kernel(out+i*8, z->img_comp[n].w2, data[0]);
+                     return 1;
+                  }
                   stbi__jpeg_reset(z);
                }
             }
@@ -2978,7 +3722,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
          return 1;
       } else { // interleaved
          int i,j,k,x,y;
-         STBI_SIMD_ALIGN(short, data[64]);
+         STBI_SIMD_ALIGN(short, data[2][64]);
          for (j=0; j < z->img_mcu_y; ++j) {
             for (i=0; i < z->img_mcu_x; ++i) {
                // scan an interleaved mcu... process scan_n components in order
@@ -2987,12 +3731,13 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                   // scan out an mcu's worth of this component; that's just determined
                   // by the basic H and V specified for the component
                   for (y=0; y < z->img_comp[n].v; ++y) {
+                     int y2 = (j*z->img_comp[n].v + y)*8;
+                     stbi_uc *out = z->img_comp[n].data+z->img_comp[n].w2*y2+i*z->img_comp[n].h*8;
+                     int pending = 0;
                      for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
                         int ha = z->img_comp[n].ha;
-                        if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
+                        if (!stbi__jpeg_decode_block(z, data[pending], z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                        pending = stbi__jpeg_idct_step(z, out, z->img_comp[n].w2, x, z->img_comp[n].h, data, pending);
                      }
                   }
                }
@@ -3077,22 +3822,48 @@ static void stbi__jpeg_dequantize(short *data, stbi__uint16 *dequant)
       data[i] *= dequant[i];
 }
 
+// number of horizontal bands to split 'rows' into: one unless a parallel
+// runner is registered, then roughly one per 'min_rows' rows, at most 64
+static int stbi__jpeg_bands(int rows, int min_rows)
+{
+   int bands = rows / min_rows;
+   if (!stbi__parallel_for_func || bands < 1) return 1;
+   return bands > 64 ? 64 : bands;
+}
+
+// dequantize and idct one horizontal band of block rows of every component
+static void stbi__jpeg_finish_band(void *user, int band)
+{
+   stbi__jpeg *z = (stbi__jpeg *) user;
+   int bands = stbi__jpeg_bands((z->s->img_y+7) >> 3, 4);
+   int i,j,n;
+   for (n=0; n < z->s->img_n; ++n) {
+      int w = (z->img_comp[n].x+7) >> 3;
+      int h = (z->img_comp[n].y+7) >> 3;
+      int j0 = h * band / bands, j1 = h * (band+1) / bands;
+      for (j=j0; j < j1; ++j) {
+         for (i=0; i < w; ++i) {
+            short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+            stbi_uc *out = z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8;
+            stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
+            if (z->idct_block_x2_kernel && i+1 < w) {
+               // neighbouring coefficient blocks are contiguous within a row
+               stbi__jpeg_dequantize(data+64, z->dequant[z->img_comp[n].tq]);
+               z->idct_block_x2_kernel(out, z->img_comp[n].w2, data, data+64);
+               ++i;
+            } else {
+               z->idct_block_kernel(out, z->img_comp[n].w2, data);
+            }
+         }
+      }
+   }
+}
+
 static void stbi__jpeg_finish(stbi__jpeg *z)
 {
    if (z->progressive) {
       // dequantize and idct the data
-      int i,j,n;
-      for (n=0; n < z->s->img_n; ++n) {
-         int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
-               stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-            }
-         }
-      }
+      stbi__parallel_for_run(stbi__jpeg_bands((z->s->img_y+7) >> 3, 4), stbi__jpeg_finish_band, z);
    }
 }
 
@@ -3643,6 +4414,73 @@ static stbi_uc *stbi__resample_row_hv_2_simd(stbi_uc *out, stbi_uc *in_near, stb
 }
 #endif
 
+#ifdef STBI_AVX2
+// same filter as stbi__resample_row_hv_2_simd, 16 input pixels per step. the
+// one-pixel shifts cross the 128-bit lane boundary, so they go through
+// permute2x128 + alignr rather than a plain byte shift.
+STBI__AVX2_TARGET
+static stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   int i=0,t0,t1;
+
+   if (w == 1) {
+      out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   for (; i < ((w-1) & ~15); i += 16) {
+      // vertical pass: 3*x + y = 4*x + (y - x)
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i diff  = _mm256_sub_epi16(farw, nearw);
+      __m256i nears = _mm256_slli_epi16(nearw, 2);
+      __m256i curr  = _mm256_add_epi16(nears, diff);
+
+      // prev = curr shifted right by one pixel, next = shifted left by one
+      __m256i lo_in = _mm256_permute2x128_si256(curr, curr, 0x08); // [0, curr.lo]
+      __m256i hi_in = _mm256_permute2x128_si256(curr, curr, 0x81); // [curr.hi, 0]
+      __m256i prev  = _mm256_insert_epi16(_mm256_alignr_epi8(curr, lo_in, 14), t1, 0);
+      __m256i next  = _mm256_insert_epi16(_mm256_alignr_epi8(hi_in, curr, 2), 3*in_near[i+16] + in_far[i+16], 15);
+
+      // horizontal pass, polyphase
+      __m256i bias = _mm256_set1_epi16(8);
+      __m256i curs = _mm256_slli_epi16(curr, 2);
+      __m256i prvd = _mm256_sub_epi16(prev, curr);
+      __m256i nxtd = _mm256_sub_epi16(next, curr);
+      __m256i curb = _mm256_add_epi16(curs, bias);
+      __m256i even = _mm256_add_epi16(prvd, curb);
+      __m256i odd  = _mm256_add_epi16(nxtd, curb);
+
+      // interleave even/odd and undo scaling; the lane-local pack leaves
+      // pixels 0-7 in the low lane and 8-15 in the high lane, i.e. in order
+      __m256i int0 = _mm256_unpacklo_epi16(even, odd);
+      __m256i int1 = _mm256_unpackhi_epi16(even, odd);
+      __m256i de0  = _mm256_srli_epi16(int0, 4);
+      __m256i de1  = _mm256_srli_epi16(int1, 4);
+      _mm256_storeu_si256((__m256i *) (out + i*2), _mm256_packus_epi16(de0, de1));
+
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = stbi__div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+#endif
+
 static stbi_uc *stbi__resample_row_generic(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
 {
    // resample with nearest-neighbor
@@ -3817,10 +4655,71 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+// 16 pixels per step with the sse2 arithmetic; the remainder goes through
+// the sse2/scalar kernel, so output matches it bit for bit.
+STBI__AVX2_TARGET
+static void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+   if (step == 4) {
+      __m256i signflip  = _mm256_set1_epi8(-0x80);
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i y_bias = _mm256_set1_epi16(128);
+      __m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+      for (; i+15 < count; i += 16) {
+         // load and widen; (v << 8) matches the sse2 unpack with zero/bias
+         __m256i y_w  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (y+i)));
+         __m256i cr_w = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (pcr+i)));
+         __m256i cb_w = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (pcb+i)));
+         __m256i yw  = _mm256_or_si256(_mm256_slli_epi16(y_w, 8), y_bias);
+         __m256i crw = _mm256_slli_epi16(_mm256_xor_si256(cr_w, signflip), 8);
+         __m256i cbw = _mm256_slli_epi16(_mm256_xor_si256(cb_w, signflip), 8);
+
+         // color transform
+         __m256i yws = _mm256_srli_epi16(yw, 4);
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+         __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+         __m256i rws = _mm256_add_epi16(cr0, yws);
+         __m256i gwt = _mm256_add_epi16(cb0, yws);
+         __m256i bws = _mm256_add_epi16(yws, cb1);
+         __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+         // descale
+         __m256i rw = _mm256_srai_epi16(rws, 4);
+         __m256i bw = _mm256_srai_epi16(bws, 4);
+         __m256i gw = _mm256_srai_epi16(gws, 4);
+
+         // back to byte and interleave; each lane holds 8 pixels' rgba
+         __m256i brb = _mm256_packus_epi16(rw, bw);
+         __m256i gxb = _mm256_packus_epi16(gw, xw);
+         __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+         __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+         __m256i o0 = _mm256_unpacklo_epi16(t0, t1); // pixels 0-3 | 8-11
+         __m256i o1 = _mm256_unpackhi_epi16(t0, t1); // pixels 4-7 | 12-15
+
+         // store
+         _mm256_storeu_si256((__m256i *) (out + 0),  _mm256_permute2x128_si256(o0, o1, 0x20));
+         _mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+         out += 64;
+      }
+   }
+   if (i < count)
+      stbi__YCbCr_to_RGB_simd(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
    j->idct_block_kernel = stbi__idct_block;
+   j->idct_block_x2_kernel = NULL;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
 
@@ -3829,6 +4728,13 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
       j->idct_block_kernel = stbi__idct_simd;
       j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
       j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
+#ifdef STBI_AVX2
+      if (stbi__avx2_available()) {
+         j->idct_block_x2_kernel = stbi__idct_avx2_x2;
+         j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+         j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+      }
+#endif
    }
 #endif
 
@@ -3862,6 +4768,151 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi_uc *output;
+   stbi_uc *lastrows; // n == 3 only: per-band scratch for the band's edge row
+   int n, decode_n, is_rgb;
+   int bands;
+   stbi__resample res_comp[4]; // resampler state at row 0
+} stbi__jpeg_convert_job;
+
+// resample and color-convert the output rows of one band. every band gets
+// its own slice of each component's linebuf, and replays the (cheap)
+// resampler state machine up to its first row, so bands are independent.
+static void stbi__jpeg_convert_band(void *user, int band)
+{
+   stbi__jpeg_convert_job *job = (stbi__jpeg_convert_job *) user;
+   stbi__jpeg *z = job->z;
+   int k, n = job->n, decode_n = job->decode_n, is_rgb = job->is_rgb;
+   unsigned int i,j;
+   unsigned int j0 = z->s->img_y * band / job->bands; // img_y < 2^24, bands <= 64
+   unsigned int j1 = z->s->img_y * (band+1) / job->bands;
+   stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+   stbi_uc *linebuf[4] = { NULL, NULL, NULL, NULL };
+   stbi_uc *lastrow = job->lastrows ? job->lastrows + (size_t) band * (n * z->s->img_x + 1) : NULL;
+   stbi__resample res_comp[4];
+
+   for (k=0; k < decode_n; ++k) {
+      stbi__resample *r = &res_comp[k];
+      *r = job->res_comp[k];
+      linebuf[k] = z->img_comp[k].linebuf + (size_t) band * (z->s->img_x + 3);
+      for (j=0; j < j0; ++j) {
+         if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < z->img_comp[k].y)
+               r->line1 += z->img_comp[k].w2;
+         }
+      }
+   }
+
+   for (j=j0; j < j1; ++j) {
+      stbi_uc *row = job->output + (size_t) n * z->s->img_x * (z->bottom_up ? z->s->img_y-1-j : j);
+      // the byte spilled past the row lands in the next row in memory: at a
+      // band edge that row is another band's, so go via scratch; bottom-up,
+      // it's the row this band wrote just before, so put its byte back
+      int scratch = lastrow && (z->bottom_up ? j == j0 && band > 0 : j+1 == j1);
+      int restore = n == 3 && z->bottom_up && j > j0;
+      stbi_uc spilled = restore ? row[n * z->s->img_x] : 0;
+      stbi_uc *out = scratch ? lastrow : row;
+      for (k=0; k < decode_n; ++k) {
+         stbi__resample *r = &res_comp[k];
+         int y_bot = r->ystep >= (r->vs >> 1);
+         coutput[k] = r->resample(linebuf[k],
+                                  y_bot ? r->line1 : r->line0,
+                                  y_bot ? r->line0 : r->line1,
+                                  r->w_lores, r->hs);
+         if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < z->img_comp[k].y)
+               r->line1 += z->img_comp[k].w2;
+         }
+      }
+      if (n >= 3) {
+         stbi_uc *y = coutput[0];
+         if (z->s->img_n == 3) {
+            if (is_rgb) {
+               for (i=0; i < z->s->img_x; ++i) {
+                  out[0] = y[i];
+                  out[1] = coutput[1][i];
+                  out[2] = coutput[2][i];
+                  out[3] = 255;
+                  out += n;
+               }
+            } else {
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else if (z->s->img_n == 4) {
+            if (z->app14_color_transform == 0) { // CMYK
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(coutput[0][i], m);
+                  out[1] = stbi__blinn_8x8(coutput[1][i], m);
+                  out[2] = stbi__blinn_8x8(coutput[2][i], m);
+                  out[3] = 255;
+                  out += n;
+               }
+            } else if (z->app14_color_transform == 2) { // YCCK
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(255 - out[0], m);
+                  out[1] = stbi__blinn_8x8(255 - out[1], m);
+                  out[2] = stbi__blinn_8x8(255 - out[2], m);
+                  out += n;
+               }
+            } else { // YCbCr + alpha?  Ignore the fourth channel for now
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = out[1] = out[2] = y[i];
+               out[3] = 255; // not used if n==3
+               out += n;
+            }
+      } else {
+         if (is_rgb) {
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i)
+                  *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+            else {
+               for (i=0; i < z->s->img_x; ++i, out += 2) {
+                  out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                  out[1] = 255;
+               }
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+            for (i=0; i < z->s->img_x; ++i) {
+               stbi_uc m = coutput[3][i];
+               stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+               stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+               stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+               out[0] = stbi__compute_y(r, g, b);
+               out[1] = 255;
+               out += n;
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+               out[1] = 255;
+               out += n;
+            }
+         } else {
+            stbi_uc *y = coutput[0];
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
+            else
+               for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+         }
+      }
+      if (scratch) memcpy(row, lastrow, (size_t) n * z->s->img_x);
+      if (restore) row[n * z->s->img_x] = spilled;
+   }
+}
+
 static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
    int n, decode_n, is_rgb;
@@ -3890,18 +4941,20 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // resample and color-convert
    {
       int k;
-      unsigned int i,j;
-      stbi_uc *output;
-      stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+      stbi__jpeg_convert_job job;
 
-      stbi__resample res_comp[4];
+      job.z = z;
+      job.n = n;
+      job.decode_n = decode_n;
+      job.is_rgb = is_rgb;
+      job.bands = stbi__jpeg_bands(z->s->img_y, 64);
 
       for (k=0; k < decode_n; ++k) {
-         stbi__resample *r = &res_comp[k];
+         stbi__resample *r = &job.res_comp[k];
 
          // allocate line buffer big enough for upsampling off the edges
-         // with upsample factor of 4
-         z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
+         // with upsample factor of 4; one per band
+         z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc_mad2(job.bands, z->s->img_x + 3, 0);
          if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
          r->hs      = z->img_h_max / z->img_comp[k].h;
@@ -3918,110 +4971,28 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
          else                               r->resample = stbi__resample_row_generic;
       }
 
-      // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-      if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-      // now go ahead and resample
-      for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi__resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
-            }
-         }
-         if (n >= 3) {
-            stbi_uc *y = coutput[0];
-            if (z->s->img_n == 3) {
-               if (is_rgb) {
-                  for (i=0; i < z->s->img_x; ++i) {
-                     out[0] = y[i];
-                     out[1] = coutput[1][i];
-                     out[2] = coutput[2][i];
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else if (z->s->img_n == 4) {
-               if (z->app14_color_transform == 0) { // CMYK
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                     out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                     out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else if (z->app14_color_transform == 2) { // YCCK
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(255 - out[0], m);
-                     out[1] = stbi__blinn_8x8(255 - out[1], m);
-                     out[2] = stbi__blinn_8x8(255 - out[2], m);
-                     out += n;
-                  }
-               } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
-                  out += n;
-               }
-         } else {
-            if (is_rgb) {
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i)
-                     *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-               else {
-                  for (i=0; i < z->s->img_x; ++i, out += 2) {
-                     out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                     out[1] = 255;
-                  }
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  stbi_uc m = coutput[3][i];
-                  stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                  stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                  stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                  out[0] = stbi__compute_y(r, g, b);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else {
-               stbi_uc *y = coutput[0];
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-               else
-                  for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
-            }
-         }
+      // the 3-channel converters store a 4th byte past each pixel, i.e. one
+      // byte into the next row. that row may belong to another band, so each
+      // band converts its edge row into scratch and copies it out.
+      job.lastrows = NULL;
+      if (n == 3 && job.bands > 1) {
+         job.lastrows = (stbi_uc *) stbi__malloc_mad3(job.bands, n * z->s->img_x, 1, job.bands);
+         if (!job.lastrows) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
       }
+
+      // can't error after this so, this is safe
+      job.output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+      if (!job.output) { STBI_FREE(job.lastrows); stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+
+      // now go ahead and resample, one horizontal band per task
+      stbi__parallel_for_run(job.bands, stbi__jpeg_convert_band, &job);
+
+      STBI_FREE(job.lastrows);
       stbi__cleanup_jpeg(z);
       *out_x = z->s->img_x;
       *out_y = z->s->img_y;
       if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
-      return output;
+      return job.output;
    }
 }
 
@@ -4031,8 +5002,9 @@ static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int re
    stbi__jpeg* j = (stbi__jpeg*) stbi__malloc(sizeof(stbi__jpeg));
    if (!j) return stbi__errpuc("outofmem", "Out of memory");
    memset(j, 0, sizeof(stbi__jpeg));
-   STBI_NOTUSED(ri);
    j->s = s;
+   j->bottom_up = stbi__flip_on_load(s) != 0;
+   ri->bottom_up = j->bottom_up;
    stbi__setup_jpeg(j);
    result = load_jpeg_image(j, x,y,comp,req_comp);
    STBI_FREE(j);
@@ -4632,6 +5604,7 @@ typedef struct
    stbi__context *s;
    stbi_uc *idata, *expanded, *out;
    int depth;
+   int bottom_up; // unfilter rows into out bottom to top
 } stbi__png;
 
 
@@ -4692,8 +5665,8 @@ static void stbi__create_png_alpha_expand8(stbi_uc *dest, stbi_uc *src, stbi__ui
    }
 }
 
-// create the png data from post-deflated data
-static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
+// create the png data from post-deflated data, storing rows bottom-up if flip
+static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color, int flip)
 {
    int bytes = (depth == 16 ? 2 : 1);
    stbi__context *s = a->s;
@@ -4738,7 +5711,7 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       // cur/prior filter buffers alternate
       stbi_uc *cur = filter_buf + (j & 1)*img_width_bytes;
       stbi_uc *prior = filter_buf + (~j & 1)*img_width_bytes;
-      stbi_uc *dest = a->out + stride*j;
+      stbi_uc *dest = a->out + stride*(flip ? y-1-j : j);
       int nk = width * filter_bytes;
       int filter = *raw++;
 
@@ -4865,7 +5838,7 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
    stbi_uc *final;
    int p;
    if (!interlaced)
-      return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color);
+      return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color, a->bottom_up);
 
    // de-interlacing
    final = (stbi_uc *) stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
@@ -4881,7 +5854,7 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
       y = (a->s->img_y - yorig[p] + yspc[p]-1) / yspc[p];
       if (x && y) {
          stbi__uint32 img_len = ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
-         if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color)) {
+         if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color, 0)) {
             STBI_FREE(final);
             return 0;
          }
@@ -4889,6 +5862,7 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
             for (i=0; i < x; ++i) {
                int out_y = j*yspc[p]+yorig[p];
                int out_x = i*xspc[p]+xorig[p];
+               if (a->bottom_up) out_y = a->s->img_y-1 - out_y;
                memcpy(final + out_y*a->s->img_x*out_bytes + out_x*out_bytes,
                       a->out + (j*x+i)*out_bytes, out_bytes);
             }
@@ -5030,6 +6004,9 @@ STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_conve
                                 : stbi__de_iphone_flag_global)
 #endif // STBI_THREAD_LOCAL
 
+#define stbi__png_unpremultiply(s)  ((s)->opt ? (s)->opt->unpremultiply      : stbi__unpremultiply_on_load)
+#define stbi__png_de_iphone(s)      ((s)->opt ? (s)->opt->convert_iphone_png : stbi__de_iphone_flag)
+
 static void stbi__de_iphone(stbi__png *z)
 {
    stbi__context *s = z->s;
@@ -5045,7 +6022,7 @@ static void stbi__de_iphone(stbi__png *z)
       }
    } else {
       STBI_ASSERT(s->img_out_n == 4);
-      if (stbi__unpremultiply_on_load) {
+      if (stbi__png_unpremultiply(s)) {
          // convert bgr to rgb and unpremultiply
          for (i=0; i < pixel_count; ++i) {
             stbi_uc a = p[3];
@@ -5219,7 +6196,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                   if (!stbi__compute_transparency(z, tc, s->img_out_n)) return 0;
                }
             }
-            if (is_iphone && stbi__de_iphone_flag && s->img_out_n > 2)
+            if (is_iphone && stbi__png_de_iphone(s) && s->img_out_n > 2)
                stbi__de_iphone(z);
             if (pal_img_n) {
                // pal_img_n == 3 or 4
@@ -5273,6 +6250,7 @@ static void *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp, st
          return stbi__errpuc("bad bits_per_channel", "PNG not supported: unsupported color depth");
       result = p->out;
       p->out = NULL;
+      ri->bottom_up = p->bottom_up;
       if (req_comp && req_comp != p->s->img_out_n) {
          if (ri->bits_per_channel == 8)
             result = stbi__convert_format((unsigned char *) result, p->s->img_out_n, req_comp, p->s->img_x, p->s->img_y);
@@ -5296,6 +6274,7 @@ static void *stbi__png_load(stbi__context *s, int *x, int *y, int *comp, int req
 {
    stbi__png p;
    p.s = s;
+   p.bottom_up = stbi__flip_on_load(s) != 0;
    return stbi__do_png(&p, x,y,comp,req_comp, ri);
 }
 
@@ -5534,9 +6513,8 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
    unsigned int mr=0,mg=0,mb=0,ma=0, all_a;
    stbi_uc pal[256][4];
    int psize=0,i,j,width;
-   int flip_vertically, pad, target;
+   int flip_vertically, flip_rows, pad, target;
    stbi__bmp_data info;
-   STBI_NOTUSED(ri);
 
    info.all_a = 255;
    if (stbi__bmp_parse_header(s, &info) == NULL)
@@ -5545,6 +6523,11 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
    flip_vertically = ((int) s->img_y) > 0;
    s->img_y = abs((int) s->img_y);
 
+   // file rows go straight to their final place, in the file's own order if
+   // the caller keeps it
+   ri->bottom_up = stbi__keep_row_order(s) ? flip_vertically : stbi__flip_on_load(s) != 0;
+   flip_rows = ri->bottom_up != flip_vertically;
+
    if (s->img_y > STBI_MAX_DIMENSIONS) return stbi__errpuc("too large","Very large image (corrupt?)");
    if (s->img_x > STBI_MAX_DIMENSIONS) return stbi__errpuc("too large","Very large image (corrupt?)");
 
@@ -5615,6 +6598,7 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
       if (info.bpp == 1) {
          for (j=0; j < (int) s->img_y; ++j) {
             int bit_offset = 7, v = stbi__get8(s);
+            z = (flip_rows ? (int) s->img_y-1-j : j) * s->img_x * target;
             for (i=0; i < (int) s->img_x; ++i) {
                int color = (v>>bit_offset)&0x1;
                out[z++] = pal[color][0];
@@ -5631,6 +6615,7 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
          }
       } else {
          for (j=0; j < (int) s->img_y; ++j) {
+            z = (flip_rows ? (int) s->img_y-1-j : j) * s->img_x * target;
             for (i=0; i < (int) s->img_x; i += 2) {
                int v=stbi__get8(s),v2=0;
                if (info.bpp == 4) {
@@ -5676,6 +6661,7 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
          if (rcount > 8 || gcount > 8 || bcount > 8 || acount > 8) { STBI_FREE(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
       }
       for (j=0; j < (int) s->img_y; ++j) {
+         z = (flip_rows ? (int) s->img_y-1-j : j) * s->img_x * target;
          if (easy) {
             for (i=0; i < (int) s->img_x; ++i) {
                unsigned char a;
@@ -5709,17 +6695,6 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
       for (i=4*s->img_x*s->img_y-1; i >= 0; i -= 4)
          out[i] = 255;
 
-   if (flip_vertically) {
-      stbi_uc t;
-      for (j=0; j < (int) s->img_y>>1; ++j) {
-         stbi_uc *p1 = out +      j     *s->img_x*target;
-         stbi_uc *p2 = out + (s->img_y-1-j)*s->img_x*target;
-         for (i=0; i < (int) s->img_x*target; ++i) {
-            t = p1[i]; p1[i] = p2[i]; p2[i] = t;
-         }
-      }
-   }
-
    if (req_comp && req_comp != target) {
       out = stbi__convert_format(out, target, req_comp, s->img_x, s->img_y);
       if (out == NULL) return out; // stbi__convert_format frees input on failure
@@ -5889,12 +6864,13 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
    //   image data
    unsigned char *tga_data;
    unsigned char *tga_palette = NULL;
+   unsigned char *tga_out = NULL;
+   int tga_col = 0, tga_row = 0, flip_rows;
    int i, j;
    unsigned char raw_data[4] = {0};
    int RLE_count = 0;
    int RLE_repeating = 0;
    int read_next_pixel = 1;
-   STBI_NOTUSED(ri);
    STBI_NOTUSED(tga_x_origin); // @TODO
    STBI_NOTUSED(tga_y_origin); // @TODO
 
@@ -5909,6 +6885,11 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
    }
    tga_inverted = 1 - ((tga_inverted >> 5) & 1);
 
+   // rows go straight to their final place, in the file's own order if the
+   // caller keeps it
+   ri->bottom_up = stbi__keep_row_order(s) ? tga_inverted : stbi__flip_on_load(s) != 0;
+   flip_rows = ri->bottom_up != tga_inverted;
+
    //   If I'm paletted, then I'll use the number of bits from the palette
    if ( tga_indexed ) tga_comp = stbi__tga_get_comp(tga_palette_bits, 0, &tga_rgb16);
    else tga_comp = stbi__tga_get_comp(tga_bits_per_pixel, (tga_image_type == 3), &tga_rgb16);
@@ -5932,7 +6913,7 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
 
    if ( !tga_indexed && !tga_is_RLE && !tga_rgb16 ) {
       for (i=0; i < tga_height; ++i) {
-         int row = tga_inverted ? tga_height -i - 1 : i;
+         int row = flip_rows ? tga_height -i - 1 : i;
          stbi_uc *tga_row = tga_data + row*tga_width*tga_comp;
          stbi__getn(s, tga_row, tga_width * tga_comp);
       }
@@ -6017,29 +6998,19 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
          } // end of reading a pixel
 
          // copy data
+         if (tga_col == 0)
+            tga_out = tga_data + (flip_rows ? tga_height-1-tga_row : tga_row) * tga_width * tga_comp;
          for (j = 0; j < tga_comp; ++j)
-           tga_data[i*tga_comp+j] = raw_data[j];
+           tga_out[j] = raw_data[j];
+         tga_out += tga_comp;
+         if (++tga_col == tga_width) {
+            tga_col = 0;
+            ++tga_row;
+         }
 
          //   in case we're in RLE mode, keep counting down
          --RLE_count;
       }
-      //   do I need to invert the image?
-      if ( tga_inverted )
-      {
-         for (j = 0; j*2 < tga_height; ++j)
-         {
-            int index1 = j * tga_width * tga_comp;
-            int index2 = (tga_height - 1 - j) * tga_width * tga_comp;
-            for (i = tga_width * tga_comp; i > 0; --i)
-            {
-               unsigned char temp = tga_data[index1];
-               tga_data[index1] = tga_data[index2];
-               tga_data[index2] = temp;
-               ++index1;
-               ++index2;
-            }
-         }
-      }
       //   clear my palette, if I had one
       if ( tga_palette != NULL )
       {
@@ -7020,7 +7991,7 @@ static void *stbi__load_gif_main(stbi__context *s, int **delays, int *x, int *y,
             }
             memcpy( out + ((layers - 1) * stride), u, stride );
             if (layers >= 2) {
-               two_back = out - 2 * stride;
+               two_back = out + (layers - 2) * stride; // out may have moved in the realloc
             }
 
             if (delays) {
@@ -7045,6 +8016,74 @@ static void *stbi__load_gif_main(stbi__context *s, int **delays, int *x, int *y,
    }
 }
 
+struct stbi_gif_stream
+{
+   stbi__context s;
+   stbi__gif g;
+   stbi_uc *frames[2]; // the last two frames; the older one is "two back" for disposal method 3
+   int count;          // frames decoded since the last rewind
+};
+
+STBIDEF stbi_gif_stream *stbi_gif_stream_open_memory(stbi_uc const *buffer, int len, int *x, int *y)
+{
+   stbi_gif_stream *gs;
+   int w, h, comp;
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   if (!stbi__gif_test(&s)) return (stbi_gif_stream *) stbi__errpuc("not GIF", "Image was not as a gif type.");
+   if (!stbi__gif_info_raw(&s, &w, &h, &comp)) return NULL;
+   if (!stbi__mad3sizes_valid(4, w, h, 0)) return (stbi_gif_stream *) stbi__errpuc("too large", "GIF image is too large");
+
+   gs = (stbi_gif_stream *) stbi__malloc(sizeof(*gs));
+   if (!gs) return (stbi_gif_stream *) stbi__errpuc("outofmem", "Out of memory");
+   memset(gs, 0, sizeof(*gs));
+   gs->frames[0] = (stbi_uc *) stbi__malloc_mad3(4, w, h, 0);
+   gs->frames[1] = (stbi_uc *) stbi__malloc_mad3(4, w, h, 0);
+   if (!gs->frames[0] || !gs->frames[1]) {
+      stbi_gif_stream_close(gs);
+      return (stbi_gif_stream *) stbi__errpuc("outofmem", "Out of memory");
+   }
+   stbi__start_mem(&gs->s,buffer,len);
+   if (x) *x = w;
+   if (y) *y = h;
+   return gs;
+}
+
+STBIDEF int stbi_gif_stream_next(stbi_gif_stream *gs, stbi_uc **frame, int *delay_ms)
+{
+   int comp;
+   stbi_uc *dst = gs->frames[gs->count & 1];
+   stbi_uc *u = stbi__gif_load_next(&gs->s, &gs->g, &comp, 4, gs->count >= 2 ? dst : 0);
+   if (u == (stbi_uc *) &gs->s) return 0; // end of animated gif marker
+   if (!u) return -1;
+   memcpy(dst, u, 4 * gs->g.w * gs->g.h);
+   ++gs->count;
+   if (frame) *frame = dst;
+   if (delay_ms) *delay_ms = gs->g.delay;
+   return 1;
+}
+
+STBIDEF void stbi_gif_stream_rewind(stbi_gif_stream *gs)
+{
+   STBI_FREE(gs->g.out);
+   STBI_FREE(gs->g.history);
+   STBI_FREE(gs->g.background);
+   memset(&gs->g, 0, sizeof(gs->g));
+   gs->count = 0;
+   stbi__rewind(&gs->s);
+}
+
+STBIDEF void stbi_gif_stream_close(stbi_gif_stream *gs)
+{
+   if (!gs) return;
+   STBI_FREE(gs->g.out);
+   STBI_FREE(gs->g.history);
+   STBI_FREE(gs->g.background);
+   STBI_FREE(gs->frames[0]);
+   STBI_FREE(gs->frames[1]);
+   STBI_FREE(gs);
+}
+
 static void *stbi__gif_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
 {
    stbi_uc *u = 0;
@@ -7166,8 +8205,8 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
    int len;
    unsigned char count, value;
    int i, j, k, c1,c2, z;
+   int bottom_up = stbi__flip_on_load(s) != 0;
    const char *headerToken;
-   STBI_NOTUSED(ri);
 
    // Check identifier
    headerToken = stbi__hdr_gettoken(s,buffer);
@@ -7210,6 +8249,7 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
    hdr_data = (float *) stbi__malloc_mad4(width, height, req_comp, sizeof(float), 0);
    if (!hdr_data)
       return stbi__errpf("outofmem", "Out of memory");
+   ri->bottom_up = bottom_up; // the file is top-down; place each scanline as we go
 
    // Load image data
    // image data is stored as some number of sca
@@ -7220,7 +8260,7 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
             stbi_uc rgbe[4];
            main_decode_loop:
             stbi__getn(s, rgbe, 4);
-            stbi__hdr_convert(hdr_data + j * width * req_comp + i * req_comp, rgbe, req_comp);
+            stbi__hdr_convert(hdr_data + (bottom_up ? height-1-j : j) * width * req_comp + i * req_comp, rgbe, req_comp);
          }
       }
    } else {
@@ -7239,7 +8279,7 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
             rgbe[1] = (stbi_uc) c2;
             rgbe[2] = (stbi_uc) len;
             rgbe[3] = (stbi_uc) stbi__get8(s);
-            stbi__hdr_convert(hdr_data, rgbe, req_comp);
+            stbi__hdr_convert(hdr_data + (bottom_up ? height-1 : 0) * width * req_comp, rgbe, req_comp);
             i = 1;
             j = 0;
             STBI_FREE(scanline);
@@ -7277,7 +8317,7 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
             }
          }
          for (i=0; i < width; ++i)
-            stbi__hdr_convert(hdr_data+(j*width + i)*req_comp, scanline + i*4, req_comp);
+            stbi__hdr_convert(hdr_data+((bottom_up ? height-1-j : j)*width + i)*req_comp, scanline + i*4, req_comp);
       }
       if (scanline)
          STBI_FREE(scanline);
@@ -7687,6 +8727,17 @@ static int stbi__is_16_main(stbi__context *s)
    return 0;
 }
 
+STBIDEF void stbi_load_options_init(stbi_load_options *opt)
+{
+   memset(opt, 0, sizeof(*opt));
+   opt->flip_vertically = stbi__vertically_flip_on_load != 0;
+   opt->keep_row_order  = stbi__keep_row_order_on_load;
+   #ifndef STBI_NO_PNG
+   opt->unpremultiply      = stbi__unpremultiply_on_load;
+   opt->convert_iphone_png = stbi__de_iphone_flag;
+   #endif
+}
+
 #ifndef STBI_NO_STDIO
 STBIDEF int stbi_info(char const *filename, int *x, int *y, int *comp)
 {